@@ -0,0 +1,384 @@
+#include "converter.hh"
+#include <algorithm>
+#include <assimp/postprocess.h>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+using bench_clock = std::chrono::steady_clock;
+
+/* every benchmark runs for at least this long */
+const static bench_clock::duration MIN_TIME = std::chrono::milliseconds(500);
+const static std::string SCENE_NAME = "bench";
+
+struct scene_params {
+        std::size_t meshes = 64;
+        /* per mesh, rounded to a square grid */
+        std::size_t vertices = 16384;
+        bool uv = true;
+        bool normals = true;
+        std::size_t materials = 8;
+        std::size_t textures = 4;
+        std::size_t texture_size = 256;
+        std::uint32_t seed = 42;
+};
+
+/* keeps the compiler from throwing away the output of a benchmark */
+volatile std::size_t bench_sink = 0;
+
+/*
+  mt19937 produces the same sequence everywhere, unlike the standard
+  distributions, so floats are made from its bits directly.
+*/
+class bench_random {
+        std::mt19937 _engine;
+
+      public:
+        explicit bench_random(std::uint32_t seed) : _engine(seed) {}
+
+        /* uniform in [0, 1) */
+        inline float unit() { return (_engine() >> 8) * 0x1p-24f; }
+        inline float range(float min, float max) {
+                return min + unit() * (max - min);
+        }
+};
+
+void write_texture_file(const fs::path &path, std::size_t size,
+                        bench_random &random) {
+        std::ofstream file(path, std::ios::out | std::ios::binary);
+        const unsigned char base[3]
+            = { static_cast<unsigned char>(random.unit() * 256),
+                static_cast<unsigned char>(random.unit() * 256),
+                static_cast<unsigned char>(random.unit() * 256) };
+
+        file << "P6\n" << size << " " << size << "\n255\n";
+        for (std::size_t y = 0; y < size; ++y) {
+                for (std::size_t x = 0; x < size; ++x) {
+                        const bool check = ((x / 16) + (y / 16)) % 2 == 0;
+                        for (unsigned char channel : base) {
+                                const int noise = random.unit() * 32;
+                                file.put(static_cast<char>(
+                                    check ? channel
+                                          : std::min(255, 255 - channel
+                                                              + noise)));
+                        }
+                }
+        }
+        if (!file)
+                throw std::runtime_error(path.string()
+                                         + ": could not write texture");
+}
+
+void write_vertex_ref(std::ostream &stream, const scene_params &params,
+                      std::size_t idx) {
+        stream << idx;
+        if (params.uv)
+                stream << "/" << idx;
+        if (params.normals)
+                stream << (params.uv ? "/" : "//") << idx;
+}
+
+/* writes a scene of params.meshes height field grids as obj with an mtl
+ * library and ppm textures, returns the path of the obj */
+fs::path generate_scene(const fs::path &dir, const scene_params &params) {
+        bench_random random(params.seed);
+        const std::size_t side = std::max<std::size_t>(
+            2, std::lround(std::sqrt(double(params.vertices))));
+        const std::size_t materials
+            = std::max<std::size_t>(1, params.materials);
+        const std::size_t columns = std::lround(
+            std::ceil(std::sqrt(double(params.meshes))));
+
+        fs::create_directories(dir);
+        for (std::size_t idx = 0; idx < params.textures; ++idx) {
+                const std::string name = "tex" + std::to_string(idx) + ".ppm";
+                write_texture_file(dir / name, params.texture_size, random);
+        }
+
+        std::ofstream mtl(dir / "scene.mtl");
+        for (std::size_t idx = 0; idx < materials; ++idx) {
+                mtl << "newmtl mat" << idx << "\nKd "
+                    << better_float(random.unit()) << " "
+                    << better_float(random.unit()) << " "
+                    << better_float(random.unit()) << "\nKs 0.1 0.1 0.1\n";
+                if (params.textures != 0 && params.uv)
+                        mtl << "map_Kd tex" << idx % params.textures
+                            << ".ppm\n";
+        }
+
+        std::ofstream obj(dir / "scene.obj");
+        obj << "mtllib scene.mtl\n";
+        std::size_t first = 1;
+        for (std::size_t mesh = 0; mesh < params.meshes; ++mesh) {
+                const float origin_x = float(mesh % columns) * side;
+                const float origin_z = float(mesh / columns) * side;
+
+                obj << "o mesh" << mesh << "\nusemtl mat" << mesh % materials
+                    << "\n";
+                for (std::size_t y = 0; y < side; ++y) {
+                        for (std::size_t x = 0; x < side; ++x) {
+                                obj << "v " << better_float(origin_x + x)
+                                    << " "
+                                    << better_float(random.range(-1, 1))
+                                    << " " << better_float(origin_z + y)
+                                    << "\n";
+                        }
+                }
+                for (std::size_t y = 0; params.uv && y < side; ++y) {
+                        for (std::size_t x = 0; x < side; ++x) {
+                                obj << "vt "
+                                    << better_float(float(x) / (side - 1))
+                                    << " "
+                                    << better_float(float(y) / (side - 1))
+                                    << "\n";
+                        }
+                }
+                for (std::size_t idx = 0;
+                     params.normals && idx < side * side; ++idx) {
+                        const float x = random.range(-0.2f, 0.2f);
+                        const float z = random.range(-0.2f, 0.2f);
+                        const float len = std::sqrt(x * x + 1 + z * z);
+                        obj << "vn " << better_float(x / len) << " "
+                            << better_float(1 / len) << " "
+                            << better_float(z / len) << "\n";
+                }
+                for (std::size_t y = 0; y + 1 < side; ++y) {
+                        for (std::size_t x = 0; x + 1 < side; ++x) {
+                                const std::size_t a = first + y * side + x;
+                                const std::size_t b = a + side;
+                                const std::size_t tris[2][3]
+                                    = { { a, a + 1, b + 1 }, { a, b + 1, b } };
+                                for (const auto &tri : tris) {
+                                        obj << "f";
+                                        for (const std::size_t idx : tri) {
+                                                obj << " ";
+                                                write_vertex_ref(obj, params,
+                                                                 idx);
+                                        }
+                                        obj << "\n";
+                                }
+                        }
+                }
+                first += side * side;
+        }
+        if (!mtl || !obj)
+                throw std::runtime_error(dir.string()
+                                         + ": could not write scene");
+        return dir / "scene.obj";
+}
+
+/* runs fn until MIN_TIME has passed and prints the time per item */
+template <typename F>
+void measure(const std::string &name, std::size_t items, const F &fn) {
+        std::size_t iterations = 0;
+        const bench_clock::time_point start = bench_clock::now();
+        bench_clock::duration elapsed;
+
+        do {
+                fn();
+                iterations += 1;
+                elapsed = bench_clock::now() - start;
+        } while (elapsed < MIN_TIME);
+
+        const double seconds
+            = std::chrono::duration<double>(elapsed).count();
+        const double count = double(items) * iterations;
+        std::cout << std::left << std::setw(28) << name << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(12)
+                  << seconds * 1e9 / count << " ns/item" << std::setw(12)
+                  << count / seconds / 1e6 << " M items/s" << std::endl;
+}
+
+void run_micro(const fs::path &obj, const fs::path &dir,
+               const scene_params &params) {
+        Assimp::Importer importer;
+        const aiScene *scene = importer.ReadFile(
+            obj.c_str(), aiProcess_Triangulate | aiProcess_FlipWindingOrder
+                             | aiProcess_JoinIdenticalVertices
+                             | aiProcess_PreTransformVertices);
+        if (scene == nullptr || scene->mNumMeshes == 0)
+                throw std::runtime_error(obj.string() + ": could not load");
+        const aiMesh *mesh = scene->mMeshes[0];
+
+        std::vector<std::string> materials;
+        for (std::size_t idx = 0; idx < scene->mNumMaterials; ++idx)
+                materials.push_back(scene->mMaterials[idx]->GetName().C_Str());
+
+        std::vector<float> floats;
+        bench_random random(params.seed);
+        for (std::size_t idx = 0; idx < (std::size_t(1) << 16); ++idx)
+                floats.push_back(random.range(-1000, 1000));
+        for (const int precision : { better_float::DEFAULT_PRECISION,
+                                     better_float::SHORTEST }) {
+                measure(precision == better_float::SHORTEST
+                            ? "better_float shortest"
+                            : "better_float",
+                        floats.size(), [&floats, precision]() {
+                                text_buffer stream;
+                                for (const float value : floats)
+                                        stream << better_float(value,
+                                                               precision)
+                                               << ' ';
+                                bench_sink = bench_sink + stream.size();
+                        });
+        }
+
+        std::vector<vertex> vertices;
+        for (std::size_t idx = 0; idx < mesh->mNumVertices; ++idx)
+                vertices.push_back(converter::make_vertex(mesh, idx));
+        measure("write_vertex", vertices.size(), [&vertices]() {
+                text_buffer stream;
+                for (const vertex &vert : vertices)
+                        converter::write_vertex(stream, vert);
+                bench_sink = bench_sink + stream.size();
+        });
+
+        measure("write_mesh", mesh->mNumVertices + mesh->mNumFaces,
+                [&materials, mesh]() {
+                        text_buffer stream;
+                        converter::write_mesh(stream, materials, 0, mesh);
+                        bench_sink = bench_sink + stream.size();
+                });
+
+        if (params.textures != 0) {
+                const fs::path from = dir / "tex0.ppm";
+                const fs::path to = dir / SCENE_NAME / ("tex0" + TEX_EXT);
+                fs::create_directories(to.parent_path());
+                measure("texture_converter::convert", 1, [&from, &to]() {
+                        texture_converter(from, to).convert();
+                });
+                const fs::path mip_to
+                    = dir / SCENE_NAME / ("tex0" + MIP_TEX_EXT);
+                measure("texture_converter::convert mip", 1,
+                        [&from, &mip_to]() {
+                                texture_options options;
+                                options.format = texture_format::mip;
+                                texture_converter(from, mip_to)
+                                    .convert(options);
+                        });
+        }
+}
+
+void run_end_to_end(const fs::path &obj, const fs::path &dir,
+                    const std::vector<std::size_t> &threads,
+                    std::size_t runs) {
+        const fs::path out_path = dir / "scene.rt";
+
+        for (const std::size_t count : threads) {
+                double best = 0.0;
+                for (std::size_t run = 0; run < runs; ++run) {
+                        converter_options options;
+                        options.threads = count;
+                        const output_file out(out_path);
+                        const bench_clock::time_point start
+                            = bench_clock::now();
+                        converter conv(obj.string(), out, SCENE_NAME,
+                                       options);
+                        conv.convert();
+                        const double seconds
+                            = std::chrono::duration<double>(
+                                  bench_clock::now() - start)
+                                  .count();
+                        if (run == 0 || seconds < best)
+                                best = seconds;
+                }
+                const double mib = fs::file_size(out_path) / 1048576.0;
+                std::cout << "end to end, " << std::setw(3) << count
+                          << " threads" << std::fixed << std::setprecision(3)
+                          << std::setw(12) << best << " s" << std::setw(12)
+                          << mib / best << " MiB/s" << std::endl;
+        }
+}
+
+int main(int argc, char *argv[]) {
+        namespace po = boost::program_options;
+        po::options_description desc("options");
+        scene_params params;
+
+        desc.add_options()("help,h", "produce a help message")(
+            "work-dir", po::value<fs::path>()->default_value("bench-data"),
+            "directory to generate the scene in and convert it from")(
+            "meshes", po::value<std::size_t>(&params.meshes)
+                          ->default_value(params.meshes),
+            "number of meshes in the scene")(
+            "vertices", po::value<std::size_t>(&params.vertices)
+                            ->default_value(params.vertices),
+            "number of vertices per mesh")(
+            "no-uv", "leave out texture coordinates")(
+            "no-normals", "leave out normals")(
+            "materials", po::value<std::size_t>(&params.materials)
+                             ->default_value(params.materials),
+            "number of materials")(
+            "textures", po::value<std::size_t>(&params.textures)
+                            ->default_value(params.textures),
+            "number of textures")(
+            "texture-size", po::value<std::size_t>(&params.texture_size)
+                                ->default_value(params.texture_size),
+            "width and height of the textures")(
+            "seed", po::value<std::uint32_t>(&params.seed)
+                        ->default_value(params.seed),
+            "seed of the scene generator")(
+            "threads,j", po::value<std::vector<std::size_t>>()->multitoken(),
+            "thread counts of the end to end runs, by default 1, 2, 4 and "
+            "every hardware thread")(
+            "runs", po::value<std::size_t>()->default_value(3),
+            "end to end runs per thread count, the fastest is reported")(
+            "generate-only", "only generate the scene")(
+            "no-micro", "skip the micro benchmarks")(
+            "no-end-to-end", "skip the end to end runs");
+
+        po::variables_map vm;
+        try {
+                po::store(po::parse_command_line(argc, argv, desc), vm);
+                po::notify(vm);
+        } catch (const std::exception &ex) {
+                std::cerr << argv[0] << ": " << ex.what() << std::endl;
+                return EXIT_FAILURE;
+        }
+        if (vm.count("help")) {
+                std::cout << desc << std::endl;
+                return EXIT_SUCCESS;
+        }
+        params.uv = vm.count("no-uv") == 0;
+        params.normals = vm.count("no-normals") == 0;
+
+        std::vector<std::size_t> threads
+            = { 1, 2, 4, std::thread::hardware_concurrency() };
+        if (vm.count("threads"))
+                threads = vm["threads"].as<std::vector<std::size_t>>();
+        std::sort(threads.begin(), threads.end());
+        threads.erase(std::unique(threads.begin(), threads.end()),
+                      threads.end());
+
+        try {
+                const fs::path dir
+                    = fs::absolute(vm["work-dir"].as<fs::path>());
+                const fs::path obj = generate_scene(dir, params);
+                if (vm.count("generate-only"))
+                        return EXIT_SUCCESS;
+                /* converted textures go next to the output */
+                fs::current_path(dir);
+                if (vm.count("no-micro") == 0)
+                        run_micro(obj, dir, params);
+                if (vm.count("no-end-to-end") == 0)
+                        run_end_to_end(obj, dir, threads,
+                                       std::max<std::size_t>(
+                                           1, vm["runs"].as<std::size_t>()));
+        } catch (const std::exception &ex) {
+                std::cerr << argv[0] << ": " << ex.what() << std::endl;
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
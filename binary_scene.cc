@@ -0,0 +1,158 @@
+#include "binary_scene.hh"
+#include "directives.hh"
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* the attributes of a binary mesh pick its vertex directive directly */
+static_assert(BINARY_ATTRIBUTE_UV == VERTEX_UV
+              && BINARY_ATTRIBUTE_NORMAL == VERTEX_NORMAL);
+
+void binary_pad(text_buffer &buffer, std::size_t size) {
+        const std::size_t count = size - buffer.size();
+        char *const first = buffer.prepare(count);
+        std::memset(first, 0, count);
+        buffer.commit(first + count);
+}
+
+binary_scene::binary_scene(const std::filesystem::path &path) : path(path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+                throw std::runtime_error(path.string()
+                                         + ": could not open file");
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+                close(fd);
+                throw std::runtime_error(path.string()
+                                         + ": could not stat file");
+        }
+        _size = st.st_size;
+        if (_size < sizeof(binary_header)) {
+                close(fd);
+                throw std::runtime_error(path.string()
+                                         + ": not a binary scene");
+        }
+        void *const data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+                throw std::runtime_error(path.string()
+                                         + ": could not map file");
+        _data = static_cast<const char *>(data);
+        try {
+                validate();
+        } catch (...) {
+                munmap(const_cast<char *>(_data), _size);
+                throw;
+        }
+}
+
+binary_scene::~binary_scene() { munmap(const_cast<char *>(_data), _size); }
+
+const binary_header &binary_scene::header() const {
+        return *reinterpret_cast<const binary_header *>(_data);
+}
+
+std::string_view binary_scene::preamble() const {
+        const binary_section &sect = header().preamble;
+        return std::string_view(_data + sect.offset, sect.size);
+}
+
+std::string_view binary_scene::string(const binary_string &str) const {
+        const binary_section &sect = header().strings;
+        if (std::uint64_t(str.offset) + str.size > sect.size)
+                throw std::runtime_error(path.string()
+                                         + ": string out of bounds");
+        return std::string_view(_data + sect.offset + str.offset, str.size);
+}
+
+std::span<const binary_texture> binary_scene::textures() const {
+        return section<binary_texture>(header().textures.offset,
+                                       header().textures.size);
+}
+
+std::span<const binary_material> binary_scene::materials() const {
+        return section<binary_material>(header().materials.offset,
+                                        header().materials.size);
+}
+
+std::span<const binary_mesh> binary_scene::meshes() const {
+        return section<binary_mesh>(header().meshes.offset,
+                                    header().meshes.size);
+}
+
+std::span<const binary_vertex>
+binary_scene::vertices(const binary_mesh &mesh) const {
+        return section<binary_vertex>(mesh.vertices_offset,
+                                      mesh.vertex_count
+                                          * sizeof(binary_vertex));
+}
+
+std::span<const binary_face>
+binary_scene::faces(const binary_mesh &mesh) const {
+        return section<binary_face>(mesh.faces_offset,
+                                    mesh.face_count * sizeof(binary_face));
+}
+
+void binary_scene::write_text(std::ostream &stream) const {
+        const std::string_view text = preamble();
+        const std::span all_materials = materials();
+
+        stream.write(text.data(), text.size());
+        for (const binary_mesh &mesh : meshes()) {
+                text_buffer chunk;
+                if (mesh.material >= all_materials.size())
+                        throw std::runtime_error(path.string()
+                                                 + ": material out of bounds");
+                write_mat_use_directive(
+                    chunk,
+                    std::string(string(all_materials[mesh.material].name)));
+                for (const binary_vertex &vert : vertices(mesh)) {
+                        write_vertex_directive(chunk, mesh.attributes,
+                                               vert.point, vert.uv,
+                                               vert.normal);
+                }
+                for (const binary_face &face : faces(mesh)) {
+                        write_face_directive(
+                            chunk, mesh.first_vertex + face.indices[0],
+                            mesh.first_vertex + face.indices[1],
+                            mesh.first_vertex + face.indices[2]);
+                }
+                stream.write(chunk.data(), chunk.size());
+        }
+}
+
+template <typename T>
+std::span<const T> binary_scene::section(std::uint64_t offset,
+                                         std::uint64_t size) const {
+        if (offset % BINARY_ALIGNMENT != 0 || offset > _size
+            || size > _size - offset || size % sizeof(T) != 0)
+                throw std::runtime_error(path.string()
+                                         + ": section out of bounds");
+        return std::span(reinterpret_cast<const T *>(_data + offset),
+                         size / sizeof(T));
+}
+
+void binary_scene::validate() const {
+        const binary_header &head = header();
+
+        if (std::memcmp(head.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0)
+                throw std::runtime_error(path.string()
+                                         + ": not a binary scene");
+        if (head.version != BINARY_VERSION)
+                throw std::runtime_error(path.string()
+                                         + ": unsupported version "
+                                         + std::to_string(head.version));
+        if (head.file_size != _size)
+                throw std::runtime_error(path.string() + ": truncated file");
+        section<char>(head.preamble.offset, head.preamble.size);
+        section<char>(head.strings.offset, head.strings.size);
+        textures();
+        materials();
+        for (const binary_mesh &mesh : meshes()) {
+                vertices(mesh);
+                faces(mesh);
+        }
+}
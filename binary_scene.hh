@@ -0,0 +1,136 @@
+#ifndef BINARY_SCENE_HH
+#define BINARY_SCENE_HH
+
+#include "format.hh"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <span>
+#include <string_view>
+
+/*
+  layout of the binary jumboRT scene. every structure is stored little
+  endian exactly as declared here, and every section starts at a multiple
+  of BINARY_ALIGNMENT so the file can be mapped and used in place.
+
+  the preamble section holds the directives that are not mesh data
+  (header comment, cameras, lights, textures and materials) in their text
+  form. the meshes follow in output order, each with a flat vertex array
+  and a flat triangle array whose indices are relative to the mesh.
+*/
+static_assert(std::endian::native == std::endian::little,
+              "the binary scene format is only implemented for little "
+              "endian hosts");
+
+constexpr char BINARY_MAGIC[8] = { 'J', 'U', 'C', 'S', 'C', 'E', 'N', 'E' };
+constexpr std::uint32_t BINARY_VERSION = 1;
+constexpr std::uint64_t BINARY_ALIGNMENT = 64;
+
+constexpr std::uint32_t BINARY_ATTRIBUTE_UV = 1 << 0;
+constexpr std::uint32_t BINARY_ATTRIBUTE_NORMAL = 1 << 1;
+
+struct binary_section {
+        std::uint64_t offset;
+        std::uint64_t size;
+};
+
+struct binary_header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t flags;
+        std::uint64_t file_size;
+        binary_section preamble;
+        binary_section strings;
+        binary_section textures;
+        binary_section materials;
+        binary_section meshes;
+};
+
+/* a string inside the strings section, not null terminated */
+struct binary_string {
+        std::uint32_t offset;
+        std::uint32_t size;
+};
+
+struct binary_texture {
+        binary_string name;
+        binary_string path;
+};
+
+struct binary_material {
+        binary_string name;
+};
+
+struct binary_mesh {
+        std::uint32_t material;
+        std::uint32_t attributes;
+        /* index of the first vertex of this mesh in the whole scene */
+        std::uint64_t first_vertex;
+        std::uint64_t vertex_count;
+        std::uint64_t face_count;
+        std::uint64_t vertices_offset;
+        std::uint64_t faces_offset;
+};
+
+struct binary_vertex {
+        math::vector<float, 3> point;
+        math::vector<float, 2> uv;
+        math::vector<float, 3> normal;
+};
+
+struct binary_face {
+        std::uint32_t indices[3];
+};
+
+static_assert(sizeof(binary_header) == 104);
+static_assert(sizeof(binary_mesh) == 48);
+static_assert(sizeof(binary_vertex) == 32);
+static_assert(sizeof(binary_face) == 12);
+
+constexpr std::uint64_t binary_align(std::uint64_t offset) {
+        return (offset + BINARY_ALIGNMENT - 1) & ~(BINARY_ALIGNMENT - 1);
+}
+
+/* appends zeros to buffer until it is size bytes long */
+void binary_pad(text_buffer &buffer, std::size_t size);
+
+/*
+  read only view of a binary scene file. the file is mapped into memory and
+  every accessor points straight into the mapping.
+*/
+class binary_scene {
+        const char *_data = nullptr;
+        std::size_t _size = 0;
+
+      public:
+        const std::filesystem::path path;
+
+        binary_scene() = delete;
+        explicit binary_scene(const std::filesystem::path &path);
+        binary_scene(const binary_scene &other) = delete;
+        ~binary_scene();
+
+        binary_scene &operator=(const binary_scene &other) = delete;
+
+        const binary_header &header() const;
+        std::string_view preamble() const;
+        std::string_view string(const binary_string &str) const;
+        std::span<const binary_texture> textures() const;
+        std::span<const binary_material> materials() const;
+        std::span<const binary_mesh> meshes() const;
+        std::span<const binary_vertex> vertices(const binary_mesh &mesh) const;
+        std::span<const binary_face> faces(const binary_mesh &mesh) const;
+
+        /* writes the scene in the text form juc would have produced */
+        void write_text(std::ostream &stream) const;
+
+      private:
+        template <typename T>
+        std::span<const T> section(std::uint64_t offset,
+                                   std::uint64_t size) const;
+        void validate() const;
+};
+
+#endif
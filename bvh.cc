@@ -0,0 +1,358 @@
+#include "bvh.hh"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+constexpr std::size_t BIN_COUNT = 16;
+constexpr std::size_t MAX_LEAF_SIZE = 8;
+/* cost of visiting a node relative to intersecting a triangle */
+constexpr float TRAVERSAL_COST = 1.0f;
+/* nodes with at most this many triangles are built by a single task */
+constexpr std::size_t PARALLEL_THRESHOLD = std::size_t(1) << 16;
+constexpr std::size_t CHUNK_SIZE = std::size_t(1) << 14;
+
+using vec3 = math::vector<float, 3>;
+
+bvh_bounds empty_bounds() {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        return { { inf, inf, inf }, { -inf, -inf, -inf } };
+}
+
+void grow(bvh_bounds &bounds, const bvh_bounds &other) {
+        for (std::size_t axis = 0; axis < 3; ++axis) {
+                bounds.min[axis] = std::min(bounds.min[axis], other.min[axis]);
+                bounds.max[axis] = std::max(bounds.max[axis], other.max[axis]);
+        }
+}
+
+void grow(bvh_bounds &bounds, const vec3 &point) {
+        grow(bounds, bvh_bounds{ point, point });
+}
+
+float area(const bvh_bounds &bounds) {
+        if (bounds.min[0] > bounds.max[0])
+                return 0.0f;
+        const float dx = bounds.max[0] - bounds.min[0];
+        const float dy = bounds.max[1] - bounds.min[1];
+        const float dz = bounds.max[2] - bounds.min[2];
+        return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+struct bin {
+        bvh_bounds bounds = empty_bounds();
+        std::size_t count = 0;
+};
+
+/* what is known about a range of triangles before splitting it */
+struct range_info {
+        bvh_bounds bounds = empty_bounds();
+        bvh_bounds centroids = empty_bounds();
+        std::array<std::array<bin, BIN_COUNT>, 3> bins;
+};
+
+std::size_t bin_index(const range_info &info, std::size_t axis,
+                      const vec3 &centroid) {
+        const float min = info.centroids.min[axis];
+        const float extent = info.centroids.max[axis] - min;
+        const std::size_t idx = (centroid[axis] - min) / extent * BIN_COUNT;
+        return std::min(idx, BIN_COUNT - 1);
+}
+
+class builder {
+        scheduler &_pool;
+        const std::vector<bvh_bounds> &_triangles;
+        std::vector<vec3> _centroids;
+        std::vector<std::uint32_t> _indices;
+
+        /* a node that still has to be built from a range of _indices */
+        struct item {
+                std::uint32_t node;
+                std::uint32_t begin, end;
+        };
+
+      public:
+        builder(scheduler &pool, const std::vector<bvh_bounds> &triangles);
+
+        bvh build();
+
+      private:
+        void measure(std::uint32_t begin, std::uint32_t end,
+                     range_info &info) const;
+        void count_bins(std::uint32_t begin, std::uint32_t end,
+                        range_info &info) const;
+        range_info measure_parallel(std::uint32_t begin, std::uint32_t end);
+        bool split(const item &range, const range_info &info,
+                   std::uint32_t &mid);
+        void build_subtree(const item &range, std::vector<bvh_node> &nodes);
+};
+
+builder::builder(scheduler &pool, const std::vector<bvh_bounds> &triangles)
+    : _pool(pool), _triangles(triangles), _centroids(triangles.size()),
+      _indices(triangles.size()) {
+        if (triangles.size() > std::numeric_limits<std::uint32_t>::max())
+                throw std::runtime_error("too many triangles for a bvh");
+        const std::size_t chunks
+            = (triangles.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        _pool.parallel_for(chunks, [this](std::size_t chunk) {
+                const std::size_t end = std::min(_triangles.size(),
+                                                 (chunk + 1) * CHUNK_SIZE);
+                for (std::size_t idx = chunk * CHUNK_SIZE; idx < end; ++idx) {
+                        const bvh_bounds &bounds = _triangles[idx];
+                        for (std::size_t axis = 0; axis < 3; ++axis)
+                                _centroids[idx][axis]
+                                    = (bounds.min[axis] + bounds.max[axis])
+                                      / 2;
+                        _indices[idx] = idx;
+                }
+        });
+}
+
+bvh builder::build() {
+        bvh result;
+        if (_indices.empty())
+                return result;
+
+        /* the nodes near the root are split here with their bins counted
+         * on the pool, everything below them is left to a task */
+        std::vector<item> stack = { { 0, 0, std::uint32_t(_indices.size()) } };
+        std::vector<item> jobs;
+        result.nodes.resize(1);
+        while (!stack.empty()) {
+                const item top = stack.back();
+                stack.pop_back();
+                if (top.end - top.begin <= PARALLEL_THRESHOLD) {
+                        jobs.push_back(top);
+                        continue;
+                }
+                const range_info info = measure_parallel(top.begin, top.end);
+                std::uint32_t mid;
+                result.nodes[top.node].bounds = info.bounds;
+                if (!split(top, info, mid)) {
+                        result.nodes[top.node].first = top.begin;
+                        result.nodes[top.node].count = top.end - top.begin;
+                        continue;
+                }
+                const std::uint32_t left = result.nodes.size();
+                result.nodes[top.node].first = left;
+                result.nodes[top.node].count = 0;
+                result.nodes.resize(left + 2);
+                stack.push_back({ left + 1, mid, top.end });
+                stack.push_back({ left, top.begin, mid });
+        }
+
+        std::vector<std::vector<bvh_node>> subtrees(jobs.size());
+        _pool.parallel_for(jobs.size(), [this, &jobs,
+                                         &subtrees](std::size_t idx) {
+                build_subtree(jobs[idx], subtrees[idx]);
+        });
+        /* the root of every subtree takes the place of its job, the rest
+         * goes at the end */
+        for (std::size_t idx = 0; idx < jobs.size(); ++idx) {
+                const std::uint32_t base = result.nodes.size();
+                const auto relocate = [base](bvh_node node) {
+                        if (node.count == 0)
+                                node.first = base + node.first - 1;
+                        return node;
+                };
+                const std::vector<bvh_node> &subtree = subtrees[idx];
+                result.nodes[jobs[idx].node] = relocate(subtree[0]);
+                std::transform(subtree.begin() + 1, subtree.end(),
+                               std::back_inserter(result.nodes), relocate);
+        }
+        result.triangles = std::move(_indices);
+        return result;
+}
+
+void builder::measure(std::uint32_t begin, std::uint32_t end,
+                      range_info &info) const {
+        for (std::uint32_t idx = begin; idx < end; ++idx) {
+                grow(info.bounds, _triangles[_indices[idx]]);
+                grow(info.centroids, _centroids[_indices[idx]]);
+        }
+}
+
+void builder::count_bins(std::uint32_t begin, std::uint32_t end,
+                         range_info &info) const {
+        for (std::size_t axis = 0; axis < 3; ++axis) {
+                if (!(info.centroids.max[axis] > info.centroids.min[axis]))
+                        continue;
+                for (std::uint32_t idx = begin; idx < end; ++idx) {
+                        const std::uint32_t tri = _indices[idx];
+                        bin &target = info.bins[axis][bin_index(
+                            info, axis, _centroids[tri])];
+                        grow(target.bounds, _triangles[tri]);
+                        target.count += 1;
+                }
+        }
+}
+
+range_info builder::measure_parallel(std::uint32_t begin, std::uint32_t end) {
+        const std::size_t chunks = (end - begin + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        const auto chunk_begin = [begin](std::size_t chunk) {
+                return std::uint32_t(begin + chunk * CHUNK_SIZE);
+        };
+        const auto chunk_end = [begin, end](std::size_t chunk) {
+                return std::uint32_t(std::min<std::size_t>(
+                    end, begin + (chunk + 1) * CHUNK_SIZE));
+        };
+        std::vector<range_info> parts(chunks);
+        range_info info;
+
+        _pool.parallel_for(chunks, [&](std::size_t chunk) {
+                measure(chunk_begin(chunk), chunk_end(chunk), parts[chunk]);
+        });
+        for (const range_info &part : parts) {
+                grow(info.bounds, part.bounds);
+                grow(info.centroids, part.centroids);
+        }
+        /* the bins are only comparable once every part uses the same
+         * centroid bounds */
+        _pool.parallel_for(chunks, [&](std::size_t chunk) {
+                parts[chunk].centroids = info.centroids;
+                count_bins(chunk_begin(chunk), chunk_end(chunk),
+                           parts[chunk]);
+        });
+        for (const range_info &part : parts) {
+                for (std::size_t axis = 0; axis < 3; ++axis) {
+                        for (std::size_t idx = 0; idx < BIN_COUNT; ++idx) {
+                                bin &target = info.bins[axis][idx];
+                                grow(target.bounds,
+                                     part.bins[axis][idx].bounds);
+                                target.count += part.bins[axis][idx].count;
+                        }
+                }
+        }
+        return info;
+}
+
+bool builder::split(const item &range, const range_info &info,
+                    std::uint32_t &mid) {
+        const std::size_t count = range.end - range.begin;
+        float best_cost = std::numeric_limits<float>::infinity();
+        std::size_t best_axis = 3, best_bin = 0;
+
+        if (count <= 1)
+                return false;
+        for (std::size_t axis = 0; axis < 3; ++axis) {
+                if (!(info.centroids.max[axis] > info.centroids.min[axis]))
+                        continue;
+                const std::array<bin, BIN_COUNT> &bins = info.bins[axis];
+                std::array<float, BIN_COUNT> right_area;
+                std::array<std::size_t, BIN_COUNT> right_count;
+                bvh_bounds bounds = empty_bounds();
+                std::size_t total = 0;
+                for (std::size_t idx = BIN_COUNT - 1; idx > 0; --idx) {
+                        grow(bounds, bins[idx].bounds);
+                        total += bins[idx].count;
+                        right_area[idx] = area(bounds);
+                        right_count[idx] = total;
+                }
+                bounds = empty_bounds();
+                total = 0;
+                for (std::size_t idx = 0; idx + 1 < BIN_COUNT; ++idx) {
+                        grow(bounds, bins[idx].bounds);
+                        total += bins[idx].count;
+                        if (total == 0 || right_count[idx + 1] == 0)
+                                continue;
+                        const float cost
+                            = area(bounds) * total
+                              + right_area[idx + 1] * right_count[idx + 1];
+                        if (cost < best_cost) {
+                                best_cost = cost;
+                                best_axis = axis;
+                                best_bin = idx;
+                        }
+                }
+        }
+
+        if (best_axis == 3) {
+                /* every centroid is the same point, so any split is as good
+                 * as another */
+                if (count <= MAX_LEAF_SIZE)
+                        return false;
+                mid = range.begin + count / 2;
+                return true;
+        }
+        const float node_area = area(info.bounds);
+        if (count <= MAX_LEAF_SIZE
+            && (node_area <= 0.0f
+                || TRAVERSAL_COST + best_cost / node_area >= count))
+                return false;
+        mid = std::partition(_indices.begin() + range.begin,
+                             _indices.begin() + range.end,
+                             [this, &info, best_axis,
+                              best_bin](std::uint32_t tri) {
+                                     return bin_index(info, best_axis,
+                                                      _centroids[tri])
+                                            <= best_bin;
+                             })
+              - _indices.begin();
+        return true;
+}
+
+void builder::build_subtree(const item &range, std::vector<bvh_node> &nodes) {
+        std::vector<item> stack = { { 0, range.begin, range.end } };
+
+        nodes.resize(1);
+        while (!stack.empty()) {
+                const item top = stack.back();
+                stack.pop_back();
+                range_info info;
+                measure(top.begin, top.end, info);
+                count_bins(top.begin, top.end, info);
+                std::uint32_t mid;
+                nodes[top.node].bounds = info.bounds;
+                if (!split(top, info, mid)) {
+                        nodes[top.node].first = top.begin;
+                        nodes[top.node].count = top.end - top.begin;
+                        continue;
+                }
+                const std::uint32_t left = nodes.size();
+                nodes[top.node].first = left;
+                nodes[top.node].count = 0;
+                nodes.resize(left + 2);
+                stack.push_back({ left + 1, mid, top.end });
+                stack.push_back({ left, top.begin, mid });
+        }
+}
+}
+
+void bvh::write(std::ostream &stream) const {
+        const char zeros[BINARY_ALIGNMENT] = {};
+        std::uint64_t offset = 0;
+        const auto put = [&stream, &offset](const void *data,
+                                            std::uint64_t size) {
+                stream.write(static_cast<const char *>(data), size);
+                offset += size;
+        };
+        const auto pad = [&put, &zeros, &offset](std::uint64_t to) {
+                put(zeros, to - offset);
+        };
+
+        bvh_header header = {};
+        std::copy_n(BVH_MAGIC, sizeof(BVH_MAGIC), header.magic);
+        header.version = BVH_VERSION;
+        header.triangle_count = triangles.size();
+        header.nodes = { binary_align(sizeof(header)),
+                         nodes.size() * sizeof(bvh_node) };
+        header.triangles
+            = { binary_align(header.nodes.offset + header.nodes.size),
+                triangles.size() * sizeof(std::uint32_t) };
+        header.file_size
+            = binary_align(header.triangles.offset + header.triangles.size);
+
+        put(&header, sizeof(header));
+        pad(header.nodes.offset);
+        put(nodes.data(), header.nodes.size);
+        pad(header.triangles.offset);
+        put(triangles.data(), header.triangles.size);
+        pad(header.file_size);
+        if (!stream)
+                throw std::runtime_error("could not write bvh");
+}
+
+bvh build_bvh(scheduler &pool, const std::vector<bvh_bounds> &triangles) {
+        return builder(pool, triangles).build();
+}
@@ -0,0 +1,62 @@
+#ifndef BVH_HH
+#define BVH_HH
+
+#include "binary_scene.hh"
+#include "format.hh"
+#include "scheduler.hh"
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/*
+  layout of the bvh sidecar, stored little endian like the binary scene and
+  with every section aligned to BINARY_ALIGNMENT.
+
+  node 0 is the root. an inner node has a count of zero and its children
+  at first and first + 1. a leaf covers the entries first to first + count
+  of the triangles section, and every entry there is the ordinal of an f
+  directive in the scene, counting from zero across all meshes.
+*/
+constexpr char BVH_MAGIC[8] = { 'J', 'U', 'C', 'B', 'V', 'H', 0, 0 };
+constexpr std::uint32_t BVH_VERSION = 1;
+
+struct bvh_bounds {
+        math::vector<float, 3> min;
+        math::vector<float, 3> max;
+};
+
+struct bvh_node {
+        bvh_bounds bounds;
+        std::uint32_t first;
+        std::uint32_t count;
+};
+
+struct bvh_header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t flags;
+        std::uint64_t file_size;
+        /* number of f directives in the scene the bvh was built for */
+        std::uint64_t triangle_count;
+        binary_section nodes;
+        binary_section triangles;
+};
+
+static_assert(sizeof(bvh_node) == 32);
+static_assert(sizeof(bvh_header) == 64);
+
+struct bvh {
+        std::vector<bvh_node> nodes;
+        std::vector<std::uint32_t> triangles;
+
+        void write(std::ostream &stream) const;
+};
+
+/* builds a bvh over triangles with the given bounds using the surface area
+ * heuristic, evaluated over a fixed number of bins per axis. nodes that
+ * are too big for a single task have their bins counted on the pool, and
+ * the subtrees below them are built as tasks of their own. may not be
+ * called from a task */
+bvh build_bvh(scheduler &pool, const std::vector<bvh_bounds> &triangles);
+
+#endif
@@ -0,0 +1,93 @@
+#include "chunk_store.hh"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+chunk_store::chunk_store(const std::filesystem::path &directory)
+    : directory(directory) {
+        std::filesystem::create_directories(directory / "staging");
+        std::ifstream manifest(manifest_path());
+        std::string line;
+
+        /* a missing or foreign manifest leaves nothing to reuse */
+        if (!std::getline(manifest, line) || line != CHUNK_STORE_VERSION)
+                return;
+        while (std::getline(manifest, line))
+                _previous.insert(line);
+}
+
+bool chunk_store::fetch(const std::string &key, text_buffer &out) {
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_previous.contains(key) && !_used.contains(key))
+                        return false;
+        }
+        std::ifstream file(chunk_path(key), std::ios::binary | std::ios::ate);
+        if (!file)
+                return false;
+        const std::size_t size = file.tellg();
+        file.seekg(0);
+        char *data = out.prepare(size);
+        if (!file.read(data, size))
+                return false;
+        out.commit(data + size);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _used.insert(key);
+        return true;
+}
+
+void chunk_store::store(const std::string &key, const text_buffer &chunk) {
+        std::ostringstream name;
+        name << getpid() << "-" << std::this_thread::get_id() << "-" << key;
+        const std::filesystem::path staged
+            = directory / "staging" / name.str();
+        const std::filesystem::path to = chunk_path(key);
+
+        {
+                std::ofstream file(staged, std::ios::binary);
+                file.write(chunk.data(), chunk.size());
+                if (!file)
+                        throw std::runtime_error(staged.string()
+                                                 + ": could not store chunk");
+        }
+        std::filesystem::create_directories(to.parent_path());
+        std::filesystem::rename(staged, to);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _used.insert(key);
+}
+
+void chunk_store::commit() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const std::filesystem::path manifest = manifest_path();
+        const std::filesystem::path staged
+            = directory / "staging" / manifest.filename();
+        std::error_code err;
+
+        {
+                std::ofstream file(staged);
+                file << CHUNK_STORE_VERSION << "\n";
+                for (const std::string &key : _used)
+                        file << key << "\n";
+                if (!file)
+                        throw std::runtime_error(
+                            manifest.string() + ": could not write manifest");
+        }
+        std::filesystem::rename(staged, manifest);
+        for (const std::string &key : _previous) {
+                if (!_used.contains(key))
+                        std::filesystem::remove(chunk_path(key), err);
+        }
+        _previous = _used;
+}
+
+std::filesystem::path chunk_store::chunk_path(const std::string &key) const {
+        return directory / key.substr(0, 2) / key;
+}
+
+std::filesystem::path chunk_store::manifest_path() const {
+        return directory / "manifest";
+}
@@ -0,0 +1,49 @@
+#ifndef CHUNK_STORE_HH
+#define CHUNK_STORE_HH
+
+#include "format.hh"
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+/* first line of the manifest, also part of every key so that chunks
+ * formatted by another version of juc are never reused */
+const static std::string CHUNK_STORE_VERSION = "juc-chunks 2";
+
+/*
+  output chunks of earlier runs of an incremental conversion. a chunk is
+  stored under a key hashed from everything it was formatted from, so an
+  unchanged mesh finds the chunks of the previous run and a changed one
+  misses them.
+
+  the manifest lists the keys used by the last run. commit replaces it
+  with the keys used by this run and removes the chunks nothing uses
+  anymore, so the store does not grow with every edit.
+*/
+class chunk_store {
+        std::mutex _mutex;
+        std::unordered_set<std::string> _previous;
+        std::unordered_set<std::string> _used;
+
+      public:
+        const std::filesystem::path directory;
+
+        chunk_store() = delete;
+        explicit chunk_store(const std::filesystem::path &directory);
+        chunk_store(const chunk_store &other) = delete;
+        ~chunk_store() = default;
+
+        chunk_store &operator=(const chunk_store &other) = delete;
+
+        /* appends the chunk to out, returns false if it is not stored */
+        bool fetch(const std::string &key, text_buffer &out);
+        void store(const std::string &key, const text_buffer &chunk);
+        void commit();
+
+      private:
+        std::filesystem::path chunk_path(const std::string &key) const;
+        std::filesystem::path manifest_path() const;
+};
+
+#endif
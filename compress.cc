@@ -0,0 +1,127 @@
+#include "compress.hh"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <zlib.h>
+#ifdef JUC_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+const std::string GZIP_NAME = "gzip";
+const std::string ZSTD_NAME = "zstd";
+/* adds a gzip header and trailer to the deflate stream */
+constexpr int GZIP_WINDOW_BITS = 15 + 16;
+constexpr int GZIP_MEM_LEVEL = 8;
+}
+
+compression parse_compression(const std::string &spec) {
+        compression result;
+        const std::size_t colon = spec.find(':');
+        const std::string name = spec.substr(0, colon);
+        int max_level;
+
+        if (name == GZIP_NAME) {
+                result.method = compression_method::gzip;
+                max_level = Z_BEST_COMPRESSION;
+        } else if (name == ZSTD_NAME) {
+#ifdef JUC_HAVE_ZSTD
+                result.method = compression_method::zstd;
+                max_level = ZSTD_maxCLevel();
+#else
+                throw std::runtime_error(spec
+                                         + ": juc was built without zstd");
+#endif
+        } else {
+                throw std::runtime_error(spec + ": unknown compression");
+        }
+        if (colon == std::string::npos)
+                return result;
+        try {
+                std::size_t end;
+                result.level = std::stoi(spec.substr(colon + 1), &end);
+                if (colon + 1 + end != spec.size())
+                        throw std::invalid_argument(spec);
+        } catch (const std::logic_error &) {
+                throw std::runtime_error(spec + ": invalid compression level");
+        }
+        if (result.level < 1 || result.level > max_level)
+                throw std::runtime_error(spec + ": compression level must be "
+                                         "between 1 and "
+                                         + std::to_string(max_level));
+        return result;
+}
+
+namespace {
+text_buffer compress_gzip(int level, const text_buffer &chunk) {
+        /* avail_in and avail_out are 32 bits, larger chunks are fed in
+         * pieces */
+        constexpr std::size_t MAX_PIECE = std::numeric_limits<uInt>::max();
+        text_buffer result;
+        z_stream stream = {};
+
+        if (deflateInit2(&stream, level == 0 ? Z_DEFAULT_COMPRESSION : level,
+                         Z_DEFLATED, GZIP_WINDOW_BITS, GZIP_MEM_LEVEL,
+                         Z_DEFAULT_STRATEGY)
+            != Z_OK)
+                throw std::runtime_error("could not start gzip compression");
+        result.reserve(deflateBound(&stream, chunk.size()));
+
+        const char *in = chunk.data();
+        std::size_t left = chunk.size();
+        int status = Z_OK;
+        while (status == Z_OK) {
+                const std::size_t piece = std::min(left, MAX_PIECE);
+                stream.next_in = reinterpret_cast<Bytef *>(
+                    const_cast<char *>(in));
+                stream.avail_in = piece;
+                const std::size_t room = std::min(
+                    MAX_PIECE, deflateBound(&stream, left) + 1);
+                char *out = result.prepare(room);
+                stream.next_out = reinterpret_cast<Bytef *>(out);
+                stream.avail_out = room;
+                status = deflate(&stream, piece == left ? Z_FINISH
+                                                        : Z_NO_FLUSH);
+                result.commit(out + (room - stream.avail_out));
+                in += piece - stream.avail_in;
+                left -= piece - stream.avail_in;
+                if (status == Z_BUF_ERROR)
+                        status = Z_OK;
+        }
+        deflateEnd(&stream);
+        if (status != Z_STREAM_END)
+                throw std::runtime_error("could not compress output");
+        return result;
+}
+
+#ifdef JUC_HAVE_ZSTD
+text_buffer compress_zstd(int level, const text_buffer &chunk) {
+        const std::size_t bound = ZSTD_compressBound(chunk.size());
+        text_buffer result;
+        char *out = result.prepare(bound);
+        const std::size_t size
+            = ZSTD_compress(out, bound, chunk.data(), chunk.size(),
+                            level == 0 ? ZSTD_CLEVEL_DEFAULT : level);
+
+        if (ZSTD_isError(size))
+                throw std::runtime_error(std::string("could not compress "
+                                                     "output: ")
+                                         + ZSTD_getErrorName(size));
+        result.commit(out + size);
+        return result;
+}
+#endif
+}
+
+text_buffer compress_chunk(const compression &comp, const text_buffer &chunk) {
+        switch (comp.method) {
+        case compression_method::gzip:
+                return compress_gzip(comp.level, chunk);
+#ifdef JUC_HAVE_ZSTD
+        case compression_method::zstd:
+                return compress_zstd(comp.level, chunk);
+#endif
+        default:
+                throw std::logic_error("compress_chunk: no compression");
+        }
+}
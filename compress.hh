@@ -0,0 +1,26 @@
+#ifndef COMPRESS_HH
+#define COMPRESS_HH
+
+#include "format.hh"
+#include <string>
+
+enum class compression_method { none, gzip, zstd };
+
+struct compression {
+        compression_method method = compression_method::none;
+        /* zero uses the default level of the method */
+        int level = 0;
+};
+
+/* parses gzip, zstd, gzip:<level> or zstd:<level> */
+compression parse_compression(const std::string &spec);
+
+/*
+  compresses chunk on its own into a gzip member or a zstd frame. both
+  formats allow members and frames to be concatenated, so the compressed
+  chunks of a scene can be written one after the other in any number and
+  still decompress to the whole scene.
+*/
+text_buffer compress_chunk(const compression &comp, const text_buffer &chunk);
+
+#endif
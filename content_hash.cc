@@ -0,0 +1,43 @@
+#include "content_hash.hh"
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+void content_hasher::update(const void *data, std::size_t size) {
+        _sha1.process_bytes(data, size);
+}
+
+void content_hasher::update(std::string_view str) {
+        /* the size keeps consecutive strings from running into each other */
+        update_value(str.size());
+        update(str.data(), str.size());
+}
+
+void content_hasher::update_file(const std::filesystem::path &path) {
+        constexpr std::size_t BLOCK_SIZE = 1 << 16;
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+                throw std::runtime_error(path.string()
+                                         + ": could not open file");
+        const std::unique_ptr<char[]> block(new char[BLOCK_SIZE]);
+        while (file) {
+                file.read(block.get(), BLOCK_SIZE);
+                update(block.get(), file.gcount());
+        }
+        if (file.bad())
+                throw std::runtime_error(path.string()
+                                         + ": could not read file");
+}
+
+std::string content_hasher::digest() {
+        boost::uuids::detail::sha1::digest_type digest;
+        std::ostringstream ss;
+
+        _sha1.get_digest(digest);
+        ss << std::hex << std::setfill('0');
+        for (const auto part : digest)
+                ss << std::setw(sizeof(part) * 2) << +part;
+        return ss.str();
+}
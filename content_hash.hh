@@ -0,0 +1,32 @@
+#ifndef CONTENT_HASH_HH
+#define CONTENT_HASH_HH
+
+#include <boost/uuid/detail/sha1.hpp>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+/*
+  sha1 of everything passed to update, used to address cached and
+  deduplicated content. the digest is returned as lowercase hex.
+*/
+class content_hasher {
+        boost::uuids::detail::sha1 _sha1;
+
+      public:
+        content_hasher() = default;
+        ~content_hasher() = default;
+
+        void update(const void *data, std::size_t size);
+        void update(std::string_view str);
+        void update_file(const std::filesystem::path &path);
+
+        template <typename T> inline void update_value(const T &value) {
+                update(&value, sizeof(value));
+        }
+
+        std::string digest();
+};
+
+#endif
@@ -1,17 +1,30 @@
 #include "converter.hh"
+#include "binary_scene.hh"
+#include "content_hash.hh"
+#include "mesh_edit.hh"
+#include "mip_texture.hh"
+#include "native_import.hh"
+#include "postprocess.hh"
+#include "reorder.hh"
+#include "simplify.hh"
+#include "vertex_table.hh"
+#include <algorithm>
 #include <assimp/matrix4x4.h>
 #include <assimp/postprocess.h>
 #include <assimp/texture.h>
-#include <boost/asio.hpp>
-#include <boost/bind/bind.hpp>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <ctime>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <numeric>
 #include <span>
-#include <sstream>
 #include <stdexcept>
-#include <string_view>
+#include <thread>
+#include <unistd.h>
 
 vertex::vertex(math::vector<float, 3> point) : point(point) {}
 
@@ -65,6 +78,24 @@ texture_converter::texture_converter(const std::filesystem::path &from,
         std::filesystem::create_directories(tmp.remove_filename());
 }
 
+texture_converter::texture_converter(const aiTexture *texture,
+                                     const std::filesystem::path &to)
+    : _image(), from_path(texture->mFilename.C_Str()), to_path(to) {
+        if (texture->mHeight == 0) {
+                /* mWidth is the size of the compressed file in pcData */
+                if (texture->achFormatHint[0] != '\0')
+                        _image.magick(texture->achFormatHint);
+                _image.read(Magick::Blob(texture->pcData, texture->mWidth));
+        } else {
+                /* the texels are read straight out of assimp's array */
+                _image.read(texture->mWidth, texture->mHeight, "BGRA",
+                            Magick::CharPixel, texture->pcData);
+        }
+
+        std::filesystem::path tmp(to);
+        std::filesystem::create_directories(tmp.remove_filename());
+}
+
 texture_converter::texture_converter(const std::string &from,
                                      const std::string &to)
     : texture_converter(std::filesystem::path(from),
@@ -72,46 +103,377 @@ texture_converter::texture_converter(const std::string &from,
 
 texture_converter::~texture_converter() {}
 
-void texture_converter::convert() {
-        _image.depth(32);
+const std::string &texture_options::extension() const {
+        return format == texture_format::mip ? MIP_TEX_EXT : TEX_EXT;
+}
+
+std::string texture_options::conversion() const {
+        /* the key cached textures were stored under before there were
+         * options */
+        if (format == texture_format::bmp && max_size == 0)
+                return TEX_CONVERSION;
+        std::string result = format == texture_format::mip
+                                 ? "depth=8 colorspace=sRGB alpha=on mips"
+                                 : TEX_SETTINGS;
+        if (max_size != 0)
+                result += " max=" + std::to_string(max_size);
+        if (format == texture_format::mip && tiled)
+                result += " tile=" + std::to_string(MIP_TILE_SIZE);
+        return result + SEPARATOR + extension();
+}
+
+std::optional<std::filesystem::path>
+texture_table::claim(const std::filesystem::path &source,
+                     const std::filesystem::path &path) {
+        /* the same file reached through different relative paths */
+        std::error_code error;
+        std::filesystem::path key
+            = std::filesystem::weakly_canonical(source, error);
+        if (error)
+                key = source.lexically_normal();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto [it, inserted] = _paths.emplace(key.string(), path);
+        if (inserted)
+                return std::nullopt;
+        return it->second;
+}
+
+void texture_converter::convert(const texture_options &options) {
+        if (options.max_size != 0) {
+                /* keeps the aspect ratio and never enlarges */
+                Magick::Geometry size(options.max_size, options.max_size);
+                size.greater(true);
+                _image.resize(size);
+        }
+        _image.depth(options.format == texture_format::mip ? 8 : 32);
         _image.colorSpace(Magick::sRGBColorspace);
         _image.alpha(true);
-        _image.write(to_path.string());
+
+        /* written next to to_path and renamed over it, a hard link into
+         * the texture cache at to_path is replaced instead of written
+         * through. the name keeps the extension ImageMagick goes by */
+        std::ostringstream name;
+        name << "." << getpid() << "-" << std::this_thread::get_id() << "-"
+             << to_path.filename().string();
+        const std::filesystem::path tmp_path = to_path.parent_path()
+                                               / name.str();
+        try {
+                if (options.format == texture_format::bmp)
+                        _image.write(tmp_path.string());
+                else
+                        write_mip(tmp_path, options);
+        } catch (...) {
+                std::error_code error;
+                std::filesystem::remove(tmp_path, error);
+                throw;
+        }
+        std::filesystem::rename(tmp_path, to_path);
+}
+
+void texture_converter::write_mip(const std::filesystem::path &path,
+                                  const texture_options &options) {
+        mip_image image = { static_cast<std::uint32_t>(_image.columns()),
+                            static_cast<std::uint32_t>(_image.rows()),
+                            {} };
+        image.texels.resize(std::size_t(image.width) * image.height
+                            * MIP_TEXEL_SIZE);
+        _image.write(0, 0, image.width, image.height, "RGBA",
+                     Magick::CharPixel, image.texels.data());
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        write_mip_texture(file, build_mip_chain(std::move(image)),
+                          options.tiled);
 }
 
 converter::converter(const std::string &file, std::ostream &out,
-                     const std::string &name, bool gen_smooth_norm)
-    : _file(file), _out(out), _importer(), smooth(gen_smooth_norm),
-      _scene(_importer.ReadFile(
-          _file.c_str(),
-          aiProcess_Triangulate | (aiProcess_GenSmoothNormals * smooth)
-              | aiProcess_FlipWindingOrder | aiProcess_JoinIdenticalVertices
-              | aiProcess_PreTransformVertices)),
-      _pool(12), scene_name(name) {
+                     const std::string &name,
+                     const converter_options &options)
+    : converter(file, &out, nullptr, name, options) {}
+
+converter::converter(const std::string &file, const output_file &out,
+                     const std::string &name,
+                     const converter_options &options)
+    : converter(file, nullptr, &out, name, options) {}
+
+converter::converter(const std::string &file, std::ostream *sink,
+                     const output_file *output, const std::string &name,
+                     const converter_options &options)
+    : _file(file), _sink(sink), _output(output), _importer(),
+      _options(options),
+      _writer(make_writer(_sink, _output)),
+      _own_pool(_options.pool == nullptr
+                    ? std::make_unique<scheduler>(_options.threads,
+                                                  _options.statistics)
+                    : nullptr),
+      _pool(_options.pool == nullptr ? *_own_pool : *_options.pool),
+      scene_name(name) {
+        _scene = import();
         if (_scene == nullptr)
                 throw std::runtime_error("could not load file");
+        if (_options.weld && _options.format != output_format::text)
+                throw std::runtime_error(
+                    "welding is only supported for text output");
+        if (_options.compress.method != compression_method::none
+            && _options.format != output_format::text)
+                throw std::runtime_error(
+                    "compression is only supported for text output");
+        if (_options.instance
+            && (_options.weld || _options.format != output_format::text))
+                throw std::runtime_error("instancing is only supported for "
+                                         "text output without welding");
+        if (_options.chunks != nullptr && _options.weld)
+                throw std::runtime_error("incremental conversion is not "
+                                         "supported with welding");
+        if (_options.texture_cache)
+                _texture_cache = std::make_unique<texture_cache>(
+                    *_options.texture_cache, _options.texture_cache_size);
+        /* whoever shares a pool reports its size, converters built on
+         * other threads would race on it */
+        if (_options.statistics != nullptr && _own_pool != nullptr)
+                _options.statistics->threads = _pool.size();
         _out << std::setiosflags(std::ios_base::fixed);
 }
 
 converter::~converter() {
-        for (auto &x : _streams) {
-                delete x;
+        /* after a failed conversion range tasks may still be queued, they
+         * must not wait for room in the writer nobody empties anymore */
+        if (_writer != nullptr)
+                _writer->abort(std::make_exception_ptr(
+                    std::runtime_error("conversion abandoned")));
+        wait_tasks();
+}
+
+void converter::submit(task_class cls, scheduler::task &&fn) {
+        {
+                std::lock_guard<std::mutex> lock(_tasks_mutex);
+                _tasks += 1;
+        }
+        _pool.submit(cls, [this, fn = std::move(fn)]() {
+                fn();
+                std::lock_guard<std::mutex> lock(_tasks_mutex);
+                if (--_tasks == 0)
+                        _tasks_cond.notify_all();
+        });
+}
+
+void converter::wait_tasks() {
+        std::unique_lock<std::mutex> lock(_tasks_mutex);
+        _tasks_cond.wait(lock, [this]() { return _tasks == 0; });
+}
+
+const aiScene *converter::import() {
+        if (_options.native_import) {
+                {
+                        stats::phase_timer timer(_options.statistics,
+                                                 "import");
+                        _native_scene
+                            = import_native(_file, _pool, _options.grain);
+                }
+                if (_native_scene != nullptr) {
+                        /* the scene is triangulated, flipped and joined
+                         * already */
+                        stats::phase_timer timer(_options.statistics,
+                                                 "postprocess");
+                        if (_options.smooth)
+                                generate_normals(
+                                    _pool,
+                                    std::span<aiMesh *const>(
+                                        _native_scene->mMeshes,
+                                        _native_scene->mNumMeshes),
+                                    _options.grain);
+                        return _native_scene.get();
+                }
         }
+        /* the post processing steps are applied separately so they show up
+         * as their own phase */
+        {
+                stats::phase_timer timer(_options.statistics, "import");
+                if (_importer.ReadFile(_file.c_str(), 0) == nullptr)
+                        return nullptr;
+        }
+        stats::phase_timer timer(_options.statistics, "postprocess");
+        const bool native = _options.native_postprocess;
+        return _importer.ApplyPostProcessing(
+            aiProcess_Triangulate
+            | (aiProcess_GenSmoothNormals * (_options.smooth && !native))
+            | aiProcess_FlipWindingOrder
+            | (aiProcess_JoinIdenticalVertices * !native)
+            | (aiProcess_PreTransformVertices * !_options.instance));
+}
+
+void converter::postprocess_meshes() {
+        stats::phase_timer timer(_options.statistics, "native postprocess");
+        const std::span<aiMesh *const> meshes(_scene->mMeshes,
+                                              _scene->mNumMeshes);
+        /* in the same order as assimp, which joins the vertices after
+         * giving them normals */
+        if (_options.smooth)
+                generate_normals(_pool, meshes, _options.grain);
+        join_vertices(_pool, meshes, _options.grain);
 }
 
 void converter::convert() {
-        write_header();
-        write_cameras();
-        write_lights();
-        write_global_textures();
-        write_materials();
-        write_node(_scene->mRootNode);
-        _pool.join();
-        for (auto &x : _streams) {
-                for (auto &stream : *x) {
-                        _out << stream.view();
+        stats *const report = _options.statistics;
+        if (_options.native_postprocess && _native_scene == nullptr)
+                postprocess_meshes();
+        {
+                stats::phase_timer timer(report, "materials");
+                write_header();
+                write_cameras();
+                write_lights();
+                write_global_textures();
+                write_materials();
+        }
+        {
+                stats::phase_timer timer(report, "meshes");
+                if (_options.instance) {
+                        std::vector<bool> seen(_scene->mNumMeshes);
+                        collect_instances(_scene->mRootNode, aiMatrix4x4(),
+                                          seen);
+                } else {
+                        collect_meshes(_scene->mRootNode);
+                }
+                if (_options.target_triangles != 0) {
+                        std::size_t faces = 0;
+                        for (unsigned int mesh_idx : _order)
+                                faces += _scene->mMeshes[mesh_idx]->mNumFaces;
+                        const std::size_t target = _options.target_triangles;
+                        if (target < faces)
+                                simplify_meshes(double(target) / faces);
+                }
+                if (_options.reorder)
+                        reorder_meshes();
+                write_scene();
+        }
+        {
+                /* whatever texture conversion did not overlap the
+                 * meshes */
+                stats::phase_timer timer(report, "textures");
+                wait_tasks();
+                if (_texture_cache != nullptr)
+                        _texture_cache->trim();
+        }
+        stats::phase_timer timer(report, "flush");
+        if (_sink != nullptr)
+                _sink->flush();
+}
+
+void converter::convert_lod(std::ostream &out, double ratio) {
+        convert_lod(&out, nullptr, ratio);
+}
+
+void converter::convert_lod(const output_file &out, double ratio) {
+        convert_lod(nullptr, &out, ratio);
+}
+
+void converter::convert_lod(std::ostream *sink, const output_file *output,
+                            double ratio) {
+        if (_options.release_geometry)
+                throw std::runtime_error(
+                    "lod levels need the geometry that was released");
+        simplify_meshes(ratio);
+        if (_options.reorder)
+                reorder_meshes();
+        stats::phase_timer timer(_options.statistics, "lod");
+        _writer = make_writer(sink, output);
+        /* range tasks finish their mesh after handing the writer their
+         * chunk, the next level or bvh replaces what they still use */
+        try {
+                write_scene();
+        } catch (...) {
+                _writer->abort(std::current_exception());
+                wait_tasks();
+                throw;
+        }
+        wait_tasks();
+}
+
+std::unique_ptr<ordered_writer>
+converter::make_writer(std::ostream *sink, const output_file *output) const {
+        if (output != nullptr)
+                return std::make_unique<ordered_writer>(*output,
+                                                        max_buffered());
+        return std::make_unique<ordered_writer>(*sink, max_buffered());
+}
+
+void converter::write_bvh(std::ostream &out) {
+        if (_options.instance)
+                throw std::runtime_error(
+                    "a bvh can not be built for instanced output");
+        if (_options.release_geometry)
+                throw std::runtime_error(
+                    "a bvh needs the geometry that was released");
+        stats::phase_timer timer(_options.statistics, "bvh");
+
+        /* the ordinal of every face is its position in the output */
+        std::vector<std::size_t> first_face(_order.size() + 1);
+        for (std::size_t seq = 0; seq < _order.size(); ++seq) {
+                const aiMesh *mesh = _scene->mMeshes[_order[seq]];
+                first_face[seq + 1] = first_face[seq] + mesh->mNumFaces;
+        }
+        std::vector<bvh_bounds> bounds(first_face.back());
+        const std::size_t grain = std::max<std::size_t>(1, _options.grain);
+        _pool.parallel_for((bounds.size() + grain - 1) / grain,
+                           [&](std::size_t chunk) {
+                const std::size_t begin = chunk * grain;
+                const std::size_t end = std::min(bounds.size(), begin + grain);
+                std::size_t seq = std::upper_bound(first_face.begin(),
+                                                   first_face.end(), begin)
+                                  - first_face.begin() - 1;
+                for (std::size_t face = begin; face < end; ++face) {
+                        while (face >= first_face[seq + 1])
+                                ++seq;
+                        const aiMesh *mesh = _scene->mMeshes[_order[seq]];
+                        bounds[face] = face_bounds(
+                            mesh, mesh->mFaces[face - first_face[seq]]);
+                }
+        });
+        build_bvh(_pool, bounds).write(out);
+}
+
+bvh_bounds converter::face_bounds(const aiMesh *mesh, const aiFace &face) {
+        bvh_bounds result;
+        result.min = make_vertex(mesh, face.mIndices[0]).point;
+        result.max = result.min;
+        for (std::size_t idx = 1; idx < 3; ++idx) {
+                const math::vector<float, 3> point
+                    = make_vertex(mesh, face.mIndices[idx]).point;
+                for (std::size_t axis = 0; axis < 3; ++axis) {
+                        result.min[axis] = std::min(result.min[axis],
+                                                    point[axis]);
+                        result.max[axis] = std::max(result.max[axis],
+                                                    point[axis]);
                 }
         }
+        return result;
+}
+
+void converter::write_scene() {
+        write_preamble();
+        write_meshes();
+        if (_options.instance)
+                write_instances();
+        _writer->finish();
+}
+
+void converter::simplify_meshes(double ratio) {
+        stats::phase_timer timer(_options.statistics, "simplify");
+        if (_face_counts.empty()) {
+                for (std::size_t idx = 0; idx < _scene->mNumMeshes; ++idx)
+                        _face_counts.push_back(
+                            _scene->mMeshes[idx]->mNumFaces);
+        }
+        _pool.parallel_for(_scene->mNumMeshes, [this, ratio](std::size_t idx) {
+                simplify_mesh(_scene->mMeshes[idx],
+                              std::ceil(_face_counts[idx] * ratio));
+        });
+}
+
+void converter::reorder_meshes() {
+        stats::phase_timer timer(_options.statistics, "reorder");
+        _pool.parallel_for(_scene->mNumMeshes, [this](std::size_t idx) {
+                reorder_mesh(_scene->mMeshes[idx]);
+        });
 }
 
 void converter::write_header() {
@@ -191,69 +553,604 @@ void converter::write_light_point(const aiLight *light) {
              << light->mColorDiffuse << "\n";
 }
 
-void converter::write_node(const aiNode *node) {
-        const std::span indices(node->mMeshes, node->mNumMeshes);
-        /*
-        std::for_each_n(node->mMeshes, node->mNumMeshes,
-                        [this](unsigned int idx) {
-                                write_mesh(_out, _scene->mMeshes[idx]);
-                        });
-        */
-        std::vector<std::ostringstream> *vec
-            = new std::vector<std::ostringstream>(node->mNumMeshes);
-
-        std::size_t stream_idx = 0;
-        for (std::size_t mesh_idx : indices) {
-                const std::size_t vertices_count = _vertices_count;
-                boost::asio::post(_pool, [this, vec, stream_idx, mesh_idx,
-                                          vertices_count]() {
-                        write_mesh(vec->at(stream_idx), _materials,
-                                   vertices_count, _scene->mMeshes[mesh_idx]);
+void converter::collect_meshes(const aiNode *node) {
+        _order.insert(_order.end(), node->mMeshes,
+                      node->mMeshes + node->mNumMeshes);
+        std::for_each_n(
+            node->mChildren, node->mNumChildren,
+            [this](const aiNode *child) { collect_meshes(child); });
+}
+
+void converter::collect_instances(const aiNode *node,
+                                  const aiMatrix4x4 &parent,
+                                  std::vector<bool> &seen) {
+        const aiMatrix4x4 transform = parent * node->mTransformation;
+
+        for (unsigned int idx = 0; idx < node->mNumMeshes; ++idx) {
+                const unsigned int mesh_idx = node->mMeshes[idx];
+                if (!seen[mesh_idx])
+                        _order.push_back(mesh_idx);
+                seen[mesh_idx] = true;
+                _instances.push_back({ mesh_idx, transform });
+        }
+        for (unsigned int idx = 0; idx < node->mNumChildren; ++idx)
+                collect_instances(node->mChildren[idx], transform, seen);
+}
+
+void converter::write_instances() {
+        text_buffer stream;
+        for (const mesh_instance &inst : _instances)
+                write_instance_directive(stream, inst.mesh,
+                                         make_transform(inst.transform));
+        emit(_writer->reserve(), std::move(stream));
+}
+
+void converter::weld_meshes() {
+        std::size_t expected = 0;
+        for (unsigned int mesh_idx : _order)
+                expected += _scene->mMeshes[mesh_idx]->mNumVertices;
+        _vertices = std::make_unique<vertex_table>(expected);
+        _handles.assign(_order.size(), {});
+
+        _pool.parallel_for(_order.size(), [this](std::size_t seq) {
+                const aiMesh *mesh = _scene->mMeshes[_order[seq]];
+                const unsigned int attributes = vertex_attributes(mesh);
+                std::vector<std::uint64_t> &handles = _handles[seq];
+                handles.resize(mesh->mNumVertices);
+                for (std::size_t idx = 0; idx < handles.size(); ++idx) {
+                        vertex vert = make_vertex(mesh, idx);
+                        if (_options.weld_epsilon > 0.0f)
+                                vert = quantize(vert, _options.weld_epsilon);
+                        handles[idx] = _vertices->insert(
+                            vert, attributes,
+                            vertex_table::position(seq, idx));
+                }
+        });
+        /* a vertex is written by the mesh that holds its first occurrence,
+         * so its index is the number of vertices owned before it */
+        std::vector<std::size_t> first_index(_order.size());
+        _pool.parallel_for(_order.size(), [this,
+                                           &first_index](std::size_t seq) {
+                const std::vector<std::uint64_t> &handles = _handles[seq];
+                for (std::size_t idx = 0; idx < handles.size(); ++idx) {
+                        if (_vertices->owner(handles[idx])
+                            == vertex_table::position(seq, idx))
+                                first_index[seq] += 1;
+                }
+        });
+        std::exclusive_scan(first_index.begin(), first_index.end(),
+                            first_index.begin(), std::size_t(0));
+        _pool.parallel_for(_order.size(), [this,
+                                           &first_index](std::size_t seq) {
+                const std::vector<std::uint64_t> &handles = _handles[seq];
+                std::size_t index = first_index[seq];
+                for (std::size_t idx = 0; idx < handles.size(); ++idx) {
+                        if (_vertices->owner(handles[idx])
+                            == vertex_table::position(seq, idx))
+                                _vertices->set_index(handles[idx], index++);
+                }
+        });
+}
+
+void converter::write_meshes() {
+        const std::size_t grain = std::max<std::size_t>(1, _options.grain);
+
+        _vertices_count = 0;
+        if (_options.weld)
+                weld_meshes();
+        if (_options.chunks != nullptr) {
+                _mesh_hashes.assign(_order.size(), {});
+                _pool.parallel_for(_order.size(), [this](std::size_t seq) {
+                        _mesh_hashes[seq]
+                            = hash_mesh(_scene->mMeshes[_order[seq]]);
                 });
-                /*
-                write_mesh(vec->at(stream_idx), _materials, _vertices_count,
-                           _scene->mMeshes[mesh_idx]);
-                */
-                stream_idx += 1;
-                _vertices_count += _scene->mMeshes[mesh_idx]->mNumVertices;
         }
-        _streams.push_back(vec);
+        _remaining = std::make_unique<std::atomic<std::size_t>[]>(
+            _order.size());
+        _mesh_costs.assign(_order.size(), 0);
+        _in_flight = 0;
+        _budget_failed = false;
+        for (std::size_t seq = 0; seq < _order.size(); ++seq) {
+                const aiMesh *mesh = _scene->mMeshes[_order[seq]];
+                const std::size_t vertices = mesh->mNumVertices;
+                const std::size_t faces = mesh->mNumFaces;
+                /* the first vertex range also writes the mat_use directive,
+                 * so there is one even when the mesh has no vertices */
+                const std::size_t vertex_ranges
+                    = std::max<std::size_t>(1, (vertices + grain - 1) / grain);
+                const std::size_t face_ranges = (faces + grain - 1) / grain;
+                /* faces inside a mesh block start counting at its first
+                 * vertex */
+                const std::size_t face_offset
+                    = _options.instance ? 0 : _vertices_count;
+
+                /* the same estimate the writers reserve room with */
+                _mesh_costs[seq] = vertices * 96 + faces * 32;
+                if (!admit_mesh(seq))
+                        break;
+                _remaining[seq] = vertex_ranges + face_ranges;
+                for (std::size_t idx = 0; idx < vertex_ranges; ++idx) {
+                        post_range({ seq, false, idx * grain,
+                                     std::min(vertices, (idx + 1) * grain),
+                                     face_offset });
+                }
+                for (std::size_t idx = 0; idx < face_ranges; ++idx) {
+                        post_range({ seq, true, idx * grain,
+                                     std::min(faces, (idx + 1) * grain),
+                                     face_offset });
+                }
+                _vertices_count += vertices;
+        }
+}
+
+void converter::post_range(const mesh_range &range) {
+        const std::size_t slot = _writer->reserve();
+        submit(task_class::cpu, [this, slot, range]() {
+                try {
+                        stats *const report = _options.statistics;
+                        chunk_store *const chunks = _options.chunks;
+                        const std::string key = chunks != nullptr
+                                                    ? range_key(range)
+                                                    : std::string();
+                        text_buffer stream;
+                        const bool reused = chunks != nullptr
+                                            && chunks->fetch(key, stream);
+                        /* reused ranges are part of the output as much
+                         * as formatted ones */
+                        if (report != nullptr) {
+                                const std::size_t count
+                                    = range.end - range.begin;
+                                report->add_geometry(range.faces ? 0 : count,
+                                                     range.faces ? count : 0);
+                        }
+                        if (report != nullptr && !range.faces
+                            && _options.format == output_format::text)
+                                measure_error(range);
+                        if (!reused) {
+                                write_range(stream, range);
+                                stream = encode_chunk(std::move(stream));
+                                if (chunks != nullptr)
+                                        chunks->store(key, stream);
+                        } else if (report != nullptr) {
+                                report->add_bytes(0, stream.size());
+                        }
+                        if (chunks != nullptr && report != nullptr)
+                                report->add_chunk(reused);
+                        _writer->submit(slot, std::move(stream));
+                        if (--_remaining[range.seq] == 0)
+                                finish_mesh(range.seq);
+                } catch (...) {
+                        _writer->abort(std::current_exception());
+                        std::lock_guard<std::mutex> lock(_budget_mutex);
+                        _budget_failed = true;
+                        _budget_cond.notify_all();
+                }
+        });
+}
+
+void converter::write_range(text_buffer &stream,
+                            const mesh_range &range) const {
+        const aiMesh *mesh = _scene->mMeshes[_order[range.seq]];
+
+        if (_options.format == output_format::binary) {
+                if (range.faces)
+                        write_faces_binary(stream, mesh, range.begin,
+                                           range.end);
+                else
+                        write_vertices_binary(stream, mesh, range.begin,
+                                              range.end);
+        } else if (range.faces) {
+                if (_options.weld)
+                        write_faces_welded(stream, range.seq, range.begin,
+                                           range.end);
+                else
+                        write_faces(stream, range.face_offset, mesh,
+                                    range.begin, range.end);
+        } else {
+                if (range.begin == 0 && _options.instance)
+                        write_mesh_begin_directive(stream, _order[range.seq]);
+                if (range.begin == 0)
+                        write_mat_use_directive(
+                            stream, _materials[mesh->mMaterialIndex]);
+                if (_options.weld)
+                        write_vertices_welded(stream, range.seq, range.begin,
+                                              range.end);
+                else
+                        write_vertices(stream, mesh, range.begin, range.end,
+                                       _options.precision);
+        }
+        /* the block ends with the last face range, or with the only vertex
+         * range of a mesh without faces */
+        if (_options.instance
+            && (range.faces ? range.end == mesh->mNumFaces
+                            : mesh->mNumFaces == 0
+                                  && range.end == mesh->mNumVertices))
+                write_mesh_end_directive(stream);
+}
+
+void converter::measure_error(const mesh_range &range) const {
+        const aiMesh *mesh = _scene->mMeshes[_order[range.seq]];
+        const vertex_precision &precision = _options.precision;
+        const auto error = [](const auto &from, const auto &to,
+                              int decimals) {
+                double result = 0.0;
+                for (std::size_t idx = 0; idx < from.size(); ++idx)
+                        result = std::max<double>(
+                            result, std::abs(from[idx]
+                                             - round_decimals(to[idx],
+                                                              decimals)));
+                return result;
+        };
+        double point = 0.0, uv = 0.0, normal = 0.0;
+
+        for (std::size_t idx = range.begin; idx < range.end; ++idx) {
+                const vertex vert = make_vertex(mesh, idx);
+                point = std::max(point, error(vert.point, vert.point,
+                                              precision.point));
+                uv = std::max(uv, error(vert.uv, vert.uv, precision.uv));
+                normal = std::max(
+                    normal, error(vert.normal,
+                                  precision.normal_bits == 0
+                                      ? vert.normal
+                                      : snap_normal(vert.normal,
+                                                    precision.normal_bits),
+                                  precision.normal));
+        }
+        _options.statistics->add_error(point, uv, normal);
+}
+
+std::string converter::range_key(const mesh_range &range) const {
+        const aiMesh *mesh = _scene->mMeshes[_order[range.seq]];
+        content_hasher hasher;
+
+        hasher.update(CHUNK_STORE_VERSION);
+        hasher.update(_mesh_hashes[range.seq]);
+        hasher.update(_materials[mesh->mMaterialIndex]);
+        hasher.update_value(_options.format);
+        hasher.update_value(_options.instance);
+        hasher.update_value(_options.compress.method);
+        hasher.update_value(_options.compress.level);
+        hasher.update_value(_options.precision);
+        hasher.update_value(_order[range.seq]);
+        hasher.update_value(range.faces);
+        hasher.update_value(range.begin);
+        hasher.update_value(range.end);
+        hasher.update_value(range.face_offset);
+        return hasher.digest();
+}
+
+std::string converter::hash_mesh(const aiMesh *mesh) {
+        const std::size_t vertices = mesh->mNumVertices;
+        content_hasher hasher;
+
+        hasher.update_value(mesh->mNumVertices);
+        hasher.update(mesh->mVertices, vertices * sizeof(aiVector3D));
+        hasher.update_value(mesh->mTextureCoords[0] != nullptr);
+        if (mesh->mTextureCoords[0] != nullptr)
+                hasher.update(mesh->mTextureCoords[0],
+                              vertices * sizeof(aiVector3D));
+        hasher.update_value(mesh->mNormals != nullptr);
+        if (mesh->mNormals != nullptr)
+                hasher.update(mesh->mNormals, vertices * sizeof(aiVector3D));
+        hasher.update_value(mesh->mNumFaces);
+        for (unsigned int idx = 0; idx < mesh->mNumFaces; ++idx) {
+                const aiFace &face = mesh->mFaces[idx];
+                hasher.update_value(face.mNumIndices);
+                hasher.update(face.mIndices,
+                              face.mNumIndices * sizeof(unsigned int));
+        }
+        return hasher.digest();
+}
+
+void converter::emit(std::size_t slot, text_buffer &&chunk) {
+        _writer->submit(slot, encode_chunk(std::move(chunk)));
+}
+
+text_buffer converter::encode_chunk(text_buffer &&chunk) const {
+        const std::size_t formatted = chunk.size();
+        if (_options.compress.method != compression_method::none
+            && !chunk.empty())
+                chunk = compress_chunk(_options.compress, chunk);
+        if (_options.statistics != nullptr)
+                _options.statistics->add_bytes(formatted, chunk.size());
+        return std::move(chunk);
+}
+
+void converter::write_preamble() {
+        if (_options.format == output_format::binary) {
+                write_binary_header();
+                return;
+        }
+        text_buffer chunk;
+        chunk << _out.view();
+        emit(_writer->reserve(), std::move(chunk));
+}
 
-        std::for_each_n(node->mChildren, node->mNumChildren,
-                        [this](const aiNode *child) { write_node(child); });
+void converter::finish_mesh(std::size_t seq) {
+        if (_options.weld)
+                _handles[seq] = {};
+        if (_options.release_geometry)
+                release_geometry(_scene->mMeshes[_order[seq]]);
+        if (_options.memory_budget != 0) {
+                std::lock_guard<std::mutex> lock(_budget_mutex);
+                _in_flight -= _mesh_costs[seq];
+                _budget_cond.notify_all();
+        }
+}
+
+std::size_t converter::max_buffered() const {
+        if (_options.memory_budget == 0)
+                return _options.max_buffered;
+        return std::min(_options.max_buffered, _options.memory_budget / 2);
+}
+
+bool converter::admit_mesh(std::size_t seq) {
+        if (_options.memory_budget == 0)
+                return true;
+        const std::size_t window = _options.memory_budget / 2;
+        const std::size_t cost = _mesh_costs[seq];
+        std::unique_lock<std::mutex> lock(_budget_mutex);
+
+        /* a mesh larger than the window is formatted on its own */
+        _budget_cond.wait(lock, [this, window, cost]() {
+                return _budget_failed || _in_flight == 0
+                       || _in_flight + cost <= window;
+        });
+        _in_flight += cost;
+        return !_budget_failed;
+}
+
+void converter::write_binary_header() {
+        text_buffer strings;
+        const auto add_string = [&strings](const std::string &str) {
+                const binary_string result
+                    = { static_cast<std::uint32_t>(strings.size()),
+                        static_cast<std::uint32_t>(str.size()) };
+                strings << str;
+                return result;
+        };
+
+        std::vector<std::pair<std::string, std::string>> names;
+        for (const auto &[path, name] : _textures)
+                names.emplace_back(name, _texture_files.at(name));
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        std::vector<binary_texture> textures;
+        for (const auto &[name, path] : names)
+                textures.push_back({ add_string(name), add_string(path) });
+
+        std::vector<binary_material> materials;
+        for (const std::string &name : _materials)
+                materials.push_back({ add_string(name) });
+
+        const std::string preamble = _out.str();
+        binary_header header = {};
+        std::copy_n(BINARY_MAGIC, sizeof(BINARY_MAGIC), header.magic);
+        header.version = BINARY_VERSION;
+        std::uint64_t offset = binary_align(sizeof(binary_header));
+        const auto add_section = [&offset](std::uint64_t size) {
+                const binary_section result = { offset, size };
+                offset = binary_align(offset + size);
+                return result;
+        };
+        header.preamble = add_section(preamble.size());
+        header.strings = add_section(strings.size());
+        header.textures
+            = add_section(textures.size() * sizeof(binary_texture));
+        header.materials
+            = add_section(materials.size() * sizeof(binary_material));
+        header.meshes = add_section(_order.size() * sizeof(binary_mesh));
+
+        std::vector<binary_mesh> meshes;
+        std::uint64_t first_vertex = 0;
+        for (unsigned int mesh_idx : _order) {
+                const aiMesh *mesh = _scene->mMeshes[mesh_idx];
+                binary_mesh record = {};
+                record.material = mesh->mMaterialIndex;
+                record.attributes = vertex_attributes(mesh);
+                record.first_vertex = first_vertex;
+                record.vertex_count = mesh->mNumVertices;
+                record.face_count = mesh->mNumFaces;
+                record.vertices_offset
+                    = add_section(record.vertex_count * sizeof(binary_vertex))
+                          .offset;
+                record.faces_offset
+                    = add_section(record.face_count * sizeof(binary_face))
+                          .offset;
+                meshes.push_back(record);
+                first_vertex += mesh->mNumVertices;
+        }
+        header.file_size = offset;
+
+        text_buffer out;
+        out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+        binary_pad(out, header.preamble.offset);
+        out << preamble;
+        binary_pad(out, header.strings.offset);
+        out.append(strings.data(), strings.size());
+        binary_pad(out, header.textures.offset);
+        out.append(reinterpret_cast<const char *>(textures.data()),
+                   header.textures.size);
+        binary_pad(out, header.materials.offset);
+        out.append(reinterpret_cast<const char *>(materials.data()),
+                   header.materials.size);
+        binary_pad(out, header.meshes.offset);
+        out.append(reinterpret_cast<const char *>(meshes.data()),
+                   header.meshes.size);
+        binary_pad(out, binary_align(out.size()));
+        emit(_writer->reserve(), std::move(out));
 }
 
 void converter::write_global_textures() {
-        std::for_each_n(
-            _scene->mTextures, _scene->mNumTextures,
-            [this](const aiTexture *texture) { convert_texture(texture); });
+        for (std::size_t idx = 0; idx < _scene->mNumTextures; ++idx) {
+                convert_texture(idx, _scene->mTextures[idx]);
+        }
 }
 
 void converter::write_materials() {
+        if (_options.dedup)
+                hash_textures();
         std::for_each_n(
             _scene->mMaterials, _scene->mNumMaterials,
             [this](const aiMaterial *material) { write_material(material); });
 }
 
-void converter::convert_texture(const aiTexture *texture) {
-        if (texture->mHeight == 0) {
-                convert_raw_texture(texture);
-        } else {
-                convert_compressed_texture(texture);
+void converter::convert_texture(std::size_t idx, const aiTexture *texture) {
+        /* materials refer to embedded textures either as *idx or, in some
+         * formats, by their original file name */
+        const std::string ref = "*" + std::to_string(idx);
+        const std::string file = texture->mFilename.C_Str();
+        const std::string name
+            = file.empty() ? EMBEDDED_TEX_PREFIX + std::to_string(idx)
+                           : texture_name(file);
+        const std::filesystem::path out_path = texture_path(name);
+
+        if (_options.dedup) {
+                content_hasher hasher;
+                hasher.update(texture->pcData, embedded_size(texture));
+                /* raw texels are not a file, so they never match one */
+                if (texture->mHeight != 0)
+                        hasher.update(std::to_string(texture->mWidth) + "x"
+                                      + std::to_string(texture->mHeight));
+                if (const auto known = known_texture(hasher.digest(), name)) {
+                        _textures[ref] = *known;
+                        if (!file.empty())
+                                _textures[file] = *known;
+                        return;
+                }
         }
+
+        _out << TEX_DIRECTIVE << SEPARATOR << TEX_PREFIX << name << SEPARATOR
+             << out_path.string() << "\n";
+        _textures[ref] = name;
+        _texture_files[name] = out_path.string();
+        if (!file.empty())
+                _textures[file] = name;
+        submit(task_class::io, [this, texture, out_path]() {
+                try {
+                        count_texture(converter::write_embedded_texture(
+                            texture, out_path, _texture_cache.get(),
+                            _options.textures));
+                } catch (const std::exception &ex) {
+                        std::cerr << "error: " << ex.what() << std::endl;
+                }
+        });
 }
 
-void converter::write_texture(const std::string &scene_name,
+void converter::hash_textures() {
+        std::vector<std::string> paths;
+        for (unsigned int mat = 0; mat < _scene->mNumMaterials; ++mat) {
+                const aiMaterial *material = _scene->mMaterials[mat];
+                for (std::size_t type = 0; type <= AI_TEXTURE_TYPE_MAX;
+                     ++type) {
+                        aiString path;
+                        for (unsigned int idx = 0;
+                             material->GetTexture(
+                                 static_cast<aiTextureType>(type), idx, &path)
+                             == AI_SUCCESS;
+                             ++idx) {
+                                if (path.length != 0
+                                    && _scene->GetEmbeddedTexture(
+                                           path.C_Str())
+                                           == nullptr)
+                                        paths.push_back(path.C_Str());
+                        }
+                }
+        }
+        std::sort(paths.begin(), paths.end());
+        paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+        std::vector<std::string> hashes(paths.size());
+        _pool.parallel_for(paths.size(), [this, &paths,
+                                          &hashes](std::size_t idx) {
+                const std::filesystem::path rel_path
+                    = std::filesystem::path(_file).remove_filename()
+                      / paths[idx];
+                /* a missing texture is reported when it is converted */
+                if (!std::filesystem::is_regular_file(rel_path))
+                        return;
+                content_hasher hasher;
+                hasher.update_file(rel_path);
+                hashes[idx] = hasher.digest();
+        });
+        for (std::size_t idx = 0; idx < paths.size(); ++idx) {
+                if (!hashes[idx].empty())
+                        _texture_hashes[paths[idx]] = hashes[idx];
+        }
+}
+
+std::optional<std::string> converter::known_texture(const std::string &hash,
+                                                    const std::string &name) {
+        const auto [it, inserted] = _texture_names.emplace(hash, name);
+        if (inserted)
+                return std::nullopt;
+        return it->second;
+}
+
+void converter::count_texture(bool cached) const {
+        if (_options.statistics != nullptr)
+                _options.statistics->add_texture(cached);
+}
+
+bool converter::write_texture(const std::string &scene_name,
                               const std::string &file,
-                              const std::string &tex_path) {
+                              const std::string &tex_path,
+                              texture_cache *cache,
+                              const texture_options &options) {
         const std::string name = converter::texture_name(tex_path);
         const std::filesystem::path out_path
-            = converter::texture_path(scene_name, name);
+            = converter::texture_path(scene_name, name, options.extension());
         std::filesystem::path rel_path
             = std::filesystem::path(file).remove_filename()
               / std::filesystem::path(tex_path);
 
-        texture_converter(rel_path.string(), out_path.string()).convert();
+        if (cache == nullptr) {
+                texture_converter(rel_path.string(), out_path.string())
+                    .convert(options);
+                return false;
+        }
+        if (!std::filesystem::exists(rel_path))
+                throw std::runtime_error(rel_path.string()
+                                         + ": does not exist");
+        const std::string entry = texture_cache::entry_name(
+            rel_path, options.conversion(), options.extension());
+        if (cache->fetch(entry, out_path))
+                return true;
+        const std::filesystem::path staged = cache->staging_path(entry);
+        texture_converter(rel_path, staged).convert(options);
+        cache->store(entry, staged, out_path);
+        return false;
+}
+
+std::size_t converter::embedded_size(const aiTexture *texture) {
+        /* mWidth is the size of a compressed texture */
+        return texture->mHeight == 0 ? texture->mWidth
+                                     : std::size_t(texture->mWidth)
+                                           * texture->mHeight
+                                           * sizeof(aiTexel);
+}
+
+bool converter::write_embedded_texture(const aiTexture *texture,
+                                       const std::filesystem::path &out_path,
+                                       texture_cache *cache,
+                                       const texture_options &options) {
+        if (cache == nullptr) {
+                texture_converter(texture, out_path).convert(options);
+                return false;
+        }
+        /* raw textures are described by their size as much as by their
+         * texels */
+        const std::string entry = texture_cache::entry_name(
+            texture->pcData, embedded_size(texture),
+            options.conversion() + SEPARATOR + std::to_string(texture->mWidth)
+                + "x" + std::to_string(texture->mHeight),
+            options.extension());
+        if (cache->fetch(entry, out_path))
+                return true;
+        const std::filesystem::path staged = cache->staging_path(entry);
+        texture_converter(texture, staged).convert(options);
+        cache->store(entry, staged, out_path);
+        return false;
 }
 
 void converter::write_material(const aiMaterial *material) {
@@ -268,34 +1165,66 @@ void converter::write_material(const aiMaterial *material) {
                             != AI_SUCCESS) {
                                 break;
                         }
+                        const aiTexture *embedded
+                            = _scene->GetEmbeddedTexture(path.C_Str());
+                        if (embedded != nullptr
+                            && !_textures.contains(path.C_Str())) {
+                                const std::size_t tex_idx
+                                    = std::find(_scene->mTextures,
+                                                _scene->mTextures
+                                                    + _scene->mNumTextures,
+                                                embedded)
+                                      - _scene->mTextures;
+                                _textures[path.C_Str()] = _textures.at(
+                                    "*" + std::to_string(tex_idx));
+                        }
+                        const auto hash = _texture_hashes.find(path.C_Str());
+                        if (hash != _texture_hashes.end()
+                            && !_textures.contains(path.C_Str())) {
+                                if (const auto known = known_texture(
+                                        hash->second,
+                                        texture_name(path.C_Str())))
+                                        _textures[path.C_Str()] = *known;
+                        }
                         if (std::string(path.C_Str()).empty() == false
                             && !_textures.contains(path.C_Str())) {
-                                boost::asio::post(_pool, [this, path]() {
-                                        try {
-                                                converter::write_texture(
-                                                    scene_name, _file,
-                                                    std::string(path.C_Str()));
-                                        } catch (const std::exception &ex) {
-                                                std::cerr
-                                                    << "error: " << ex.what()
-                                                    << std::endl;
-                                        }
-                                });
-                                convert_compressed_texture(path.C_Str());
+                                const std::filesystem::path out_path
+                                    = texture_path(
+                                        texture_name(path.C_Str()));
+                                const auto shared
+                                    = shared_texture(path.C_Str(), out_path);
+                                if (!shared)
+                                        submit_texture(path.C_Str());
+                                convert_compressed_texture(
+                                    path.C_Str(), shared.value_or(out_path));
                         }
                         ++idx;
                 }
         }
         const std::string name = material->GetName().C_Str();
-        _out << MAT_BEGIN_DIRECTIVE << SEPARATOR << MAT_PREFIX << name << "\n";
+        /* the properties are written on their own first, so a material
+         * with the same ones as an earlier material can be dropped */
+        std::ostringstream block;
+        block.flags(_out.flags());
+        std::swap(_out, block);
         write_material_diffuse(material);
         write_material_emissive(material);
         write_material_opacity(material);
         write_material_specular(material);
-        if (smooth) {
+        if (_options.smooth) {
                 _out << MAT_INDENT << MAT_SMOOTH_DIRECTIVE << "\n";
         }
-        _out << MAT_END_DIRECTIVE << "\n";
+        std::swap(_out, block);
+        if (_options.dedup) {
+                const auto [known, inserted]
+                    = _material_blocks.emplace(block.str(), name);
+                if (!inserted) {
+                        _materials.push_back(known->second);
+                        return;
+                }
+        }
+        _out << MAT_BEGIN_DIRECTIVE << SEPARATOR << MAT_PREFIX << name << "\n"
+             << block.view() << MAT_END_DIRECTIVE << "\n";
         _materials.push_back(name);
 }
 
@@ -459,46 +1388,151 @@ void converter::write_specular_directive(aiColor3D specular_color,
         }
 }
 
-void converter::write_mesh(std::ostream &stream,
+void converter::write_mesh(text_buffer &stream,
                            const std::vector<std::string> &materials,
-                           std::size_t face_offset, const aiMesh *mesh) {
-        const std::span vertices(mesh->mVertices, mesh->mNumVertices);
-        const std::span normals(mesh->mNormals, mesh->mNormals == nullptr
-                                                    ? 0
-                                                    : mesh->mNumVertices);
-        const std::span uvs(
-            mesh->mTextureCoords[0],
-            mesh->mTextureCoords[0] == nullptr ? 0 : mesh->mNumVertices);
-        stream << MAT_USE_DIRECTIVE << SEPARATOR << MAT_PREFIX
-               << materials[mesh->mMaterialIndex] << "\n";
-        for (std::size_t idx = 0; idx < vertices.size(); ++idx) {
-                const aiVector3D point = vertices[idx];
-                vertex vert;
-                vert.point = { point.x, point.z, point.y };
-                if (uvs.size() > 0) {
-                        vert.uv = { uvs[idx].x, uvs[idx].y };
-                }
-                if (normals.size() > 0) {
-                        const aiVector3D normal = normals[idx];
-                        vert.normal = { normal.x, normal.z, normal.y };
-                }
-                write_vertex(stream, vert);
+                           std::size_t face_offset, const aiMesh *mesh,
+                           const vertex_precision &precision) {
+        write_mat_use_directive(stream, materials[mesh->mMaterialIndex]);
+        write_vertices(stream, mesh, 0, mesh->mNumVertices, precision);
+        write_faces(stream, face_offset, mesh, 0, mesh->mNumFaces);
+}
+
+void converter::write_vertices(text_buffer &stream, const aiMesh *mesh,
+                               std::size_t begin, std::size_t end,
+                               const vertex_precision &precision) {
+        const unsigned int attributes = vertex_attributes(mesh);
+
+        /* a full vertex line is rarely longer than 96 characters */
+        stream.reserve(stream.size() + (end - begin) * 96);
+        for (std::size_t idx = begin; idx < end; ++idx) {
+                write_vertex(stream, make_vertex(mesh, idx), attributes,
+                             precision);
         }
-        std::for_each_n(mesh->mFaces, mesh->mNumFaces,
-                        [&stream, face_offset](const aiFace &face) {
-                                write_face(stream, face_offset, face);
-                        });
 }
 
-void converter::write_vertex(std::ostream &stream, const vertex &vertex) {
-        stream << VTN_DIRECTIVE << SEPARATOR << vertex.point << SEPARATOR
-               << vertex.uv << SEPARATOR << vertex.normal << "\n";
+void converter::write_faces(text_buffer &stream, std::size_t face_offset,
+                            const aiMesh *mesh, std::size_t begin,
+                            std::size_t end) {
+        /* and a face line rarely longer than 32 */
+        stream.reserve(stream.size() + (end - begin) * 32);
+        std::for_each(mesh->mFaces + begin, mesh->mFaces + end,
+                      [&stream, face_offset](const aiFace &face) {
+                              write_face(stream, face_offset, face);
+                      });
+}
+
+void converter::write_vertices_welded(text_buffer &stream, std::size_t seq,
+                                      std::size_t begin,
+                                      std::size_t end) const {
+        const aiMesh *mesh = _scene->mMeshes[_order[seq]];
+        const std::vector<std::uint64_t> &handles = _handles[seq];
+        const unsigned int attributes = vertex_attributes(mesh);
+
+        stream.reserve(stream.size() + (end - begin) * 96);
+        for (std::size_t idx = begin; idx < end; ++idx) {
+                if (_vertices->owner(handles[idx])
+                    == vertex_table::position(seq, idx))
+                        write_vertex(stream, make_vertex(mesh, idx),
+                                     attributes, _options.precision);
+        }
+}
+
+void converter::write_faces_welded(text_buffer &stream, std::size_t seq,
+                                   std::size_t begin, std::size_t end) const {
+        const aiMesh *mesh = _scene->mMeshes[_order[seq]];
+        const std::vector<std::uint64_t> &handles = _handles[seq];
+        const auto index = [this, &handles](unsigned int idx) {
+                return _vertices->index(handles[idx]);
+        };
+
+        stream.reserve(stream.size() + (end - begin) * 32);
+        std::for_each(mesh->mFaces + begin, mesh->mFaces + end,
+                      [&stream, &index](const aiFace &face) {
+                              write_face_directive(stream,
+                                                   index(face.mIndices[0]),
+                                                   index(face.mIndices[1]),
+                                                   index(face.mIndices[2]));
+                      });
+}
+
+vertex converter::make_vertex(const aiMesh *mesh, std::size_t idx) {
+        const aiVector3D point = mesh->mVertices[idx];
+        vertex vert{};
+        vert.point = { point.x, point.z, point.y };
+        if (mesh->mTextureCoords[0] != nullptr) {
+                const aiVector3D uv = mesh->mTextureCoords[0][idx];
+                vert.uv = { uv.x, uv.y };
+        }
+        if (mesh->mNormals != nullptr) {
+                const aiVector3D normal = mesh->mNormals[idx];
+                vert.normal = { normal.x, normal.z, normal.y };
+        }
+        return vert;
+}
+
+unsigned int converter::vertex_attributes(const aiMesh *mesh) {
+        return (mesh->mTextureCoords[0] != nullptr ? VERTEX_UV : 0)
+               | (mesh->mNormals != nullptr ? VERTEX_NORMAL : 0);
+}
+
+instance_transform converter::make_transform(const aiMatrix4x4 &matrix) {
+        /* vertices swap their y and z axes on output, so the transform is
+         * conjugated by that swap */
+        constexpr unsigned int axes[4] = { 0, 2, 1, 3 };
+        instance_transform result;
+        for (std::size_t row = 0; row < 3; ++row) {
+                for (std::size_t col = 0; col < 4; ++col)
+                        result[row][col] = matrix[axes[row]][axes[col]];
+        }
+        return result;
+}
+
+void converter::write_vertices_binary(text_buffer &stream, const aiMesh *mesh,
+                                      std::size_t begin, std::size_t end) {
+        stream.reserve(stream.size() + (end - begin) * sizeof(binary_vertex)
+                       + BINARY_ALIGNMENT);
+        for (std::size_t idx = begin; idx < end; ++idx) {
+                const vertex vert = make_vertex(mesh, idx);
+                const binary_vertex record = { vert.point, vert.uv,
+                                               vert.normal };
+                stream.append(reinterpret_cast<const char *>(&record),
+                              sizeof(record));
+        }
+        /* the last range pads the array up to the start of the faces */
+        if (end == mesh->mNumVertices) {
+                const std::size_t size = end * sizeof(binary_vertex);
+                binary_pad(stream, stream.size() + binary_align(size) - size);
+        }
 }
 
-void converter::convert_raw_texture(const aiTexture *texture) {
-        (void)texture;
-        throw std::runtime_error("conversion of embedded textures is "
-                                 "currently not implemented");
+void converter::write_faces_binary(text_buffer &stream, const aiMesh *mesh,
+                                   std::size_t begin, std::size_t end) {
+        stream.reserve(stream.size() + (end - begin) * sizeof(binary_face)
+                       + BINARY_ALIGNMENT);
+        std::for_each(mesh->mFaces + begin, mesh->mFaces + end,
+                      [&stream](const aiFace &face) {
+                              const binary_face record
+                                  = { { face.mIndices[0], face.mIndices[1],
+                                        face.mIndices[2] } };
+                              stream.append(
+                                  reinterpret_cast<const char *>(&record),
+                                  sizeof(record));
+                      });
+        if (end == mesh->mNumFaces) {
+                const std::size_t size = end * sizeof(binary_face);
+                binary_pad(stream, stream.size() + binary_align(size) - size);
+        }
+}
+
+void converter::write_vertex(text_buffer &stream, const vertex &vertex,
+                             unsigned int attributes,
+                             const vertex_precision &precision) {
+        write_vertex_directive(stream, attributes, vertex.point, vertex.uv,
+                               precision.normal_bits == 0
+                                   ? vertex.normal
+                                   : snap_normal(vertex.normal,
+                                                 precision.normal_bits),
+                               precision);
 }
 
 std::string converter::texture_name(const std::string &path) {
@@ -506,17 +1540,30 @@ std::string converter::texture_name(const std::string &path) {
 }
 
 std::filesystem::path converter::texture_path(const std::string &scene_name,
-                                              const std::string &name) {
-        return std::filesystem::path(scene_name) / (name + TEX_EXT);
+                                              const std::string &name,
+                                              const std::string &ext) {
+        return std::filesystem::path(scene_name) / (name + ext);
 }
 
 std::filesystem::path converter::texture_path(const std::string &name) {
-        return texture_path(scene_name, name);
+        return texture_path(scene_name, name, _options.textures.extension());
+}
+
+void converter::submit_texture(const std::string &tex_path) {
+        submit(task_class::io, [this, tex_path]() {
+                try {
+                        count_texture(converter::write_texture(
+                            scene_name, _file, tex_path, _texture_cache.get(),
+                            _options.textures));
+                } catch (const std::exception &ex) {
+                        std::cerr << "error: " << ex.what() << std::endl;
+                }
+        });
 }
 
-void converter::convert_compressed_texture(const std::string &tex_path) {
+void converter::convert_compressed_texture(
+    const std::string &tex_path, const std::filesystem::path &out_path) {
         const std::string name = texture_name(tex_path);
-        const std::filesystem::path out_path = texture_path(name);
         std::filesystem::path rel_path
             = std::filesystem::path(_file).remove_filename()
               / std::filesystem::path(tex_path);
@@ -525,21 +1572,17 @@ void converter::convert_compressed_texture(const std::string &tex_path) {
              << out_path.string() << "\n";
         // texture_converter(rel_path.string(), out_path.string()).convert();
         _textures[tex_path] = name;
+        _texture_files[name] = out_path.string();
 }
 
-void converter::convert_compressed_texture(const aiTexture *texture) {
-        convert_compressed_texture(texture->mFilename.C_Str());
-}
-
-std::ostream &operator<<(std::ostream &stream, const better_float &fl) {
-        std::ostringstream ss;
-        ss << std::fixed << fl.value();
-        const std::string str = ss.str();
-        std::string_view view = str;
-        view = view.substr(0, view.find_last_not_of("0") + 1);
-        if (view.ends_with('.'))
-                view = view.substr(0, view.length() - 1);
-        return stream << view;
+std::optional<std::filesystem::path>
+converter::shared_texture(const std::string &tex_path,
+                          const std::filesystem::path &out_path) const {
+        if (_options.shared_textures == nullptr)
+                return std::nullopt;
+        return _options.shared_textures->claim(
+            std::filesystem::path(_file).remove_filename() / tex_path,
+            out_path);
 }
 
 std::ostream &operator<<(std::ostream &stream, const aiColor3D &color) {
@@ -558,14 +1601,3 @@ std::ostream &operator<<(std::ostream &stream, const aiVector3D &vec) {
         return stream << better_float(vec.x) << "," << better_float(vec.y)
                       << "," << better_float(vec.z);
 }
-
-std::ostream &operator<<(std::ostream &stream,
-                         const math::vector<float, 2> &vec) {
-        return stream << better_float(vec[0]) << "," << better_float(vec[1]);
-}
-
-std::ostream &operator<<(std::ostream &stream,
-                         const math::vector<float, 3> &vec) {
-        return stream << better_float(vec[0]) << "," << better_float(vec[1])
-                      << "," << better_float(vec[2]);
-}
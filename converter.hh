@@ -1,65 +1,33 @@
 #ifndef CONVERTER_HH
 #define CONVERTER_HH
 
+#include "bvh.hh"
+#include "chunk_store.hh"
+#include "compress.hh"
+#include "directives.hh"
+#include "format.hh"
+#include "ordered_writer.hh"
+#include "scheduler.hh"
+#include "stats.hh"
+#include "texture_cache.hh"
 #include <Magick++.h>
 #include <assimp/Importer.hpp>
 #include <assimp/matrix4x4.h>
 #include <assimp/scene.h>
-#include <boost/asio/thread_pool.hpp>
+#include <assimp/texture.h>
+#include <atomic>
 #include <boost/container_hash/hash.hpp>
 #include <boost/unordered_map.hpp>
+#include <condition_variable>
 #include <filesystem>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 
-const static std::string SEPARATOR = " ";
-const static std::string COMMENT_DIRECTIVE = "#";
-const static std::string COMMENT = COMMENT_DIRECTIVE + SEPARATOR;
-const static std::string CAMERA_DIRECTIVE = "C";
-const static std::string AMBIENT_LIGHT_DIRECTIVE = "A";
-const static std::string AMBIENT_LIGHT_DEFAULT_BRIGHTNESS = "";
-const static std::string POINT_LIGHT_DIRECTIVE = "l";
-const static std::string TEX_DIRECTIVE = "tex_def";
-const static std::string MAT_USE_DIRECTIVE = "mat_use";
-const static std::string MAT_BEGIN_DIRECTIVE = "mat_beg";
-const static std::string MAT_PREFIX = "mat_";
-const static std::string MAT_INDENT = "    ";
-const static std::string MAT_DIFFUSE_DIRECTIVE = "diffuse";
-const static std::string MAT_EMISSIVE_DIRECTIVE = "emission";
-const static std::string MAT_OPACITY_DIRECTIVE = "alpha";
-const static std::string MAT_SPECULAR_DIRECTIVE = "specular";
-const static std::string MAT_GLOSSY_DIRECTIVE = "phong";
-const static std::string MAT_SPECULAR_DEFAULT_FUZZY = "0.5";
-const static std::string MAT_DEFAULT_BRIGHTNESS = "1.0";
-const static std::string BXDF_DEFAULT_WEIGHT = "1.0";
-const static std::string MAT_FILTER = "filter";
-const static std::string MAT_SMOOTH_DIRECTIVE = "smooth";
-const static std::string MAT_END_DIRECTIVE = "mat_end";
-const static std::string TEX_PREFIX = "tex_";
-const static std::string TEX_EXT = ".bmp";
-const static std::string FACE_DIRECTIVE = "f";
-const static std::string VTN_DIRECTIVE = "x";
-const static std::string VT_DIRECTIVE = "w";
-const static std::string VN_DIRECTIVE = "y";
-const static std::string V_DIRECTIVE = "v";
-
-const static std::string DEFAULT_CAMERA
-    = CAMERA_DIRECTIVE + SEPARATOR + "0,0,0 1,0,0 90";
-
-namespace math {
-template <typename T, std::size_t N> using vector = std::array<T, N>;
-}
-
-class better_float {
-        float _val;
-
-      public:
-        constexpr better_float(float val) noexcept : _val(val) {}
-        constexpr float value() const noexcept { return _val; }
-};
-
 struct vertex {
         math::vector<float, 3> point;
         math::vector<float, 2> uv;
@@ -80,9 +48,9 @@ struct vertex {
 
         void swap(vertex &other) noexcept;
 };
-/*
+
 template <> struct std::hash<vertex> {
-        constexpr std::size_t operator()(const vertex &vert) const noexcept {
+        std::size_t operator()(const vertex &vert) const noexcept {
                 std::size_t seed = 0;
                 boost::hash_combine(seed, vert.point);
                 boost::hash_combine(seed, vert.uv);
@@ -90,7 +58,42 @@ template <> struct std::hash<vertex> {
                 return seed;
         }
 };
-*/
+
+class vertex_table;
+
+/* describes what texture_converter::convert does to a texture, anything
+ * that changes its output has to change this as well */
+const static std::string TEX_SETTINGS = "depth=32 colorspace=sRGB alpha=on";
+const static std::string TEX_CONVERSION = TEX_SETTINGS + SEPARATOR + TEX_EXT;
+
+enum class texture_format { bmp, mip };
+
+struct texture_options {
+        texture_format format = texture_format::bmp;
+        /* textures larger than this on either side are scaled down to fit,
+         * zero keeps their size */
+        std::size_t max_size = 0;
+        /* store the levels of mip textures in tiles */
+        bool tiled = false;
+
+        const std::string &extension() const;
+        /* TEX_CONVERSION for the defaults, so cached textures stay valid */
+        std::string conversion() const;
+};
+
+/* the textures converted by any converter sharing it, so a texture that
+ * several models use is converted for the first of them only */
+class texture_table {
+        std::mutex _mutex;
+        std::unordered_map<std::string, std::filesystem::path> _paths;
+
+      public:
+        /* the path the texture at source was converted to before, or
+         * nullopt after recording that it is converted to path */
+        std::optional<std::filesystem::path>
+        claim(const std::filesystem::path &source,
+              const std::filesystem::path &path);
+};
 
 class texture_converter {
         Magick::Image _image;
@@ -101,42 +104,181 @@ class texture_converter {
         texture_converter() = delete;
         texture_converter(const std::filesystem::path &from,
                           const std::filesystem::path &to);
+        texture_converter(const aiTexture *texture,
+                          const std::filesystem::path &to);
         texture_converter(const std::string &from, const std::string &to);
         ~texture_converter();
 
-        void convert();
+        void convert(const texture_options &options = {});
+
+      private:
+        void write_mip(const std::filesystem::path &path,
+                       const texture_options &options);
+};
+
+enum class output_format { text, binary };
+
+struct converter_options {
+        bool smooth = false;
+        /* generate smooth normals and join identical vertices on the pool
+         * instead of in assimp's single threaded post processing */
+        bool native_postprocess = false;
+        /* read obj and binary ply files with the importers of
+         * native_import.hh, other files still go through assimp. they run
+         * on the pool from the constructor, so with a shared pool they
+         * overlap with whatever another converter is formatting */
+        bool native_import = false;
+        output_format format = output_format::text;
+        /* merge identical vertices of all meshes, vertices closer than
+         * weld_epsilon are considered identical when it is not zero */
+        bool weld = false;
+        float weld_epsilon = 0.0f;
+        /* keep the node hierarchy instead of flattening it, every mesh is
+         * written once and every node using it becomes an instance */
+        bool instance = false;
+        /* simplify the meshes until the scene has about this many
+         * triangles, zero keeps all of them */
+        std::size_t target_triangles = 0;
+        /* write textures with the same content and materials with the
+         * same properties once, under the name of the first of them */
+        bool dedup = false;
+        /* sort the faces of every mesh along a space filling curve and
+         * number the vertices in the order the faces use them */
+        bool reorder = false;
+        /* number of vertices or faces formatted by a single task */
+        std::size_t grain = std::size_t(1) << 16;
+        /* zero uses every hardware thread */
+        std::size_t threads = 0;
+        /* where to keep converted textures between runs, if anywhere */
+        std::optional<std::filesystem::path> texture_cache;
+        std::uintmax_t texture_cache_size = std::uintmax_t(4) << 30;
+        texture_options textures;
+        /* bytes of formatted meshes that may wait for an earlier mesh
+         * before the workers are held back */
+        std::size_t max_buffered = std::size_t(256) << 20;
+        /* how text output writes vertex attributes */
+        vertex_precision precision;
+        /* every chunk of output is compressed on its own by the worker
+         * that formatted it */
+        compression compress;
+        /* reuse the formatted chunks of unchanged meshes from earlier
+         * runs kept here, if anywhere */
+        chunk_store *chunks = nullptr;
+        /* free the geometry of every mesh as soon as it is written,
+         * convert_lod and write_bvh can not be used afterwards */
+        bool release_geometry = false;
+        /* bytes of memory the formatted output may take up, half of it
+         * for chunks waiting to be written and half for the meshes being
+         * formatted, zero does not limit anything beyond max_buffered */
+        std::size_t memory_budget = 0;
+        /* where to record timings and counters, if anywhere */
+        stats *statistics = nullptr;
+        /* run on this pool instead of one of its own and share converted
+         * textures through this table, for converting several models in
+         * one process */
+        scheduler *pool = nullptr;
+        texture_table *shared_textures = nullptr;
 };
 
 class converter {
         std::string _file;
-        std::ostream &_out;
+        /* the output is either a stream or a file written at offsets */
+        std::ostream *const _sink;
+        const output_file *const _output;
+        /* everything before the meshes, written out as the first chunk */
+        std::ostringstream _out;
         Assimp::Importer _importer;
-        bool smooth;
-        const aiScene *const _scene;
+        /* the scene when the native importers could read the file */
+        std::unique_ptr<aiScene> _native_scene;
+        const converter_options _options;
+        /* set first thing in the constructor, importing natively needs the
+         * pool */
+        const aiScene *_scene = nullptr;
         std::unordered_map<std::string, std::string> _textures;
-        // std::unordered_map<vertex, std::size_t> _vertices;
-        std::vector<std::vector<std::ostringstream> *> _streams;
+        /* the file every texture name was written to */
+        std::unordered_map<std::string, std::string> _texture_files;
+        std::unique_ptr<texture_cache> _texture_cache;
+        std::unique_ptr<vertex_table> _vertices;
+        /* for every mesh in _order the entries of its vertices in
+         * _vertices when welding */
+        std::vector<std::vector<std::uint64_t>> _handles;
         std::size_t _vertices_count = 0;
         std::vector<std::string> _materials;
-        boost::asio::thread_pool _pool;
+        /* content hash of every texture file the materials use, the name
+         * the first texture with a hash was written as and the material
+         * written for every block of material properties when deduping */
+        std::unordered_map<std::string, std::string> _texture_hashes;
+        std::unordered_map<std::string, std::string> _texture_names;
+        std::unordered_map<std::string, std::string> _material_blocks;
+        /* indices of the meshes in the order they are written */
+        std::vector<unsigned int> _order;
+        struct mesh_instance {
+                unsigned int mesh;
+                aiMatrix4x4 transform;
+        };
+        std::vector<mesh_instance> _instances;
+        /* number of unfinished range tasks of every mesh in _order */
+        std::unique_ptr<std::atomic<std::size_t>[]> _remaining;
+        /* number of faces of every mesh before simplifying it */
+        std::vector<std::size_t> _face_counts;
+        /* content hash of every mesh in _order for the chunk store */
+        std::vector<std::string> _mesh_hashes;
+        std::unique_ptr<ordered_writer> _writer;
+        /* estimated output size of the meshes that are being formatted,
+         * new meshes wait for room in the memory budget */
+        std::mutex _budget_mutex;
+        std::condition_variable _budget_cond;
+        std::size_t _in_flight = 0;
+        bool _budget_failed = false;
+        std::vector<std::size_t> _mesh_costs;
+        /* tasks submitted to the pool that have not finished yet. a
+         * shared pool outlives the converter, so these are waited for
+         * before anything they use goes away */
+        std::mutex _tasks_mutex;
+        std::condition_variable _tasks_cond;
+        std::size_t _tasks = 0;
+        /* null when the pool is shared through the options */
+        std::unique_ptr<scheduler> _own_pool;
+        scheduler &_pool;
 
       public:
         const std::string scene_name;
 
         converter() = delete;
         converter(const std::string &file, std::ostream &out,
-                  const std::string &name, bool gen_smooth_norm);
+                  const std::string &name, const converter_options &options);
+        converter(const std::string &file, const output_file &out,
+                  const std::string &name, const converter_options &options);
         ~converter();
 
         void convert();
+        /* writes the scene again after simplifying every mesh to ratio of
+         * its original faces, may only be called after convert and with a
+         * ratio lower than any before */
+        void convert_lod(std::ostream &out, double ratio);
+        void convert_lod(const output_file &out, double ratio);
+        /* writes a bvh over the faces of the scene as last written */
+        void write_bvh(std::ostream &out);
 
         inline const std::string &get_file() const { return _file; }
 
       private:
+        converter(const std::string &file, std::ostream *sink,
+                  const output_file *output, const std::string &name,
+                  const converter_options &options);
+        void convert_lod(std::ostream *sink, const output_file *output,
+                         double ratio);
+        std::unique_ptr<ordered_writer>
+        make_writer(std::ostream *sink, const output_file *output) const;
+        const aiScene *import();
         void write_global_textures();
         void write_cameras();
         void write_lights();
         void write_materials();
+        void hash_textures();
+        /* the name a texture with this hash was already written as */
+        std::optional<std::string> known_texture(const std::string &hash,
+                                                 const std::string &name);
         void write_header();
 
         /*
@@ -175,50 +317,113 @@ class converter {
         void write_glossy_directive(aiColor3D glossy_color,
                                     const std::string &tex_path);
 
-        void write_node(const aiNode *node);
-        /*
-          TODO
-          first make write_mesh static and check if it works
-
-          then try to buffer write_mesh output in ostringstreams and
-          print it at the end and check if it works
+        void collect_meshes(const aiNode *node);
+        void collect_instances(const aiNode *node, const aiMatrix4x4 &parent,
+                               std::vector<bool> &seen);
+        void write_instances();
+        /* the post processing steps native_postprocess takes from assimp */
+        void postprocess_meshes();
+        void weld_meshes();
+        void simplify_meshes(double ratio);
+        void reorder_meshes();
+        static bvh_bounds face_bounds(const aiMesh *mesh, const aiFace &face);
+        void write_scene();
+        std::size_t max_buffered() const;
+        /* returns false when a task failed and nothing more should be
+         * formatted */
+        bool admit_mesh(std::size_t seq);
+        /* submits fn to the pool as a task of this converter */
+        void submit(task_class cls, scheduler::task &&fn);
+        void wait_tasks();
+        void write_meshes();
+        void write_preamble();
+        void write_binary_header();
+        void emit(std::size_t slot, text_buffer &&chunk);
+        /* compresses the chunk if requested and counts its bytes */
+        text_buffer encode_chunk(text_buffer &&chunk) const;
+        static std::string hash_mesh(const aiMesh *mesh);
 
-          then make it multi threaded
-        */
-        static void write_mesh(std::ostream &stream,
-                               const std::vector<std::string> &materials,
-                               std::size_t face_offset, const aiMesh *mesh);
-        static void write_vertex(std::ostream &stream, const vertex &vert);
-        inline static void write_face(std::ostream &stream,
+        /* the vertices or faces in [begin, end) of the mesh _order[seq] */
+        struct mesh_range {
+                std::size_t seq;
+                bool faces;
+                std::size_t begin, end;
+                std::size_t face_offset;
+        };
+        void post_range(const mesh_range &range);
+        /* records how far the vertices of the range move when written */
+        void measure_error(const mesh_range &range) const;
+        std::string range_key(const mesh_range &range) const;
+        void write_range(text_buffer &stream, const mesh_range &range) const;
+        void finish_mesh(std::size_t seq);
+        static void write_vertices(text_buffer &stream, const aiMesh *mesh,
+                                   std::size_t begin, std::size_t end,
+                                   const vertex_precision &precision);
+        static void write_faces(text_buffer &stream, std::size_t face_offset,
+                                const aiMesh *mesh, std::size_t begin,
+                                std::size_t end);
+        void write_vertices_welded(text_buffer &stream, std::size_t seq,
+                                   std::size_t begin, std::size_t end) const;
+        void write_faces_welded(text_buffer &stream, std::size_t seq,
+                                std::size_t begin, std::size_t end) const;
+        static void write_vertices_binary(text_buffer &stream,
+                                          const aiMesh *mesh,
+                                          std::size_t begin, std::size_t end);
+        static void write_faces_binary(text_buffer &stream, const aiMesh *mesh,
+                                       std::size_t begin, std::size_t end);
+        inline static void write_face(text_buffer &stream,
                                       std::size_t face_offset,
                                       const aiFace &face) {
-                stream << FACE_DIRECTIVE << SEPARATOR
-                       << face_offset + face.mIndices[0] << SEPARATOR
-                       << face_offset + face.mIndices[1] << SEPARATOR
-                       << face_offset + face.mIndices[2] << std::endl;
+                write_face_directive(stream, face_offset + face.mIndices[0],
+                                     face_offset + face.mIndices[1],
+                                     face_offset + face.mIndices[2]);
         }
-        void convert_texture(const aiTexture *texture);
-        void convert_raw_texture(const aiTexture *texture);
-        void convert_compressed_texture(const std::string &path);
-        void convert_compressed_texture(const aiTexture *texture);
+        void convert_texture(std::size_t idx, const aiTexture *texture);
+        /* converts the texture file at path on the pool */
+        void submit_texture(const std::string &path);
+        void convert_compressed_texture(const std::string &path,
+                                        const std::filesystem::path &out_path);
+        /* where another converter sharing the texture table put the
+         * texture at path, nullopt if this one has to convert it */
+        std::optional<std::filesystem::path>
+        shared_texture(const std::string &path,
+                       const std::filesystem::path &out_path) const;
         std::filesystem::path texture_path(const std::string &name);
+        void count_texture(bool cached) const;
 
       public:
+        static void write_mesh(text_buffer &stream,
+                               const std::vector<std::string> &materials,
+                               std::size_t face_offset, const aiMesh *mesh,
+                               const vertex_precision &precision = {});
+        static vertex make_vertex(const aiMesh *mesh, std::size_t idx);
+        static instance_transform make_transform(const aiMatrix4x4 &matrix);
+        static void write_vertex(text_buffer &stream, const vertex &vert,
+                                 unsigned int attributes = VERTEX_UV_NORMAL,
+                                 const vertex_precision &precision = {});
+        /* the attributes the vertex directives of mesh carry */
+        static unsigned int vertex_attributes(const aiMesh *mesh);
         static std::filesystem::path
-        texture_path(const std::string &scene_name, const std::string &name);
+        texture_path(const std::string &scene_name, const std::string &name,
+                     const std::string &ext = TEX_EXT);
         static std::string texture_name(const std::string &path);
-        static void write_texture(const std::string &scene_name,
+        /* these return true when the texture came from the cache */
+        static bool write_texture(const std::string &scene_name,
                                   const std::string &file,
-                                  const std::string &path);
+                                  const std::string &path,
+                                  texture_cache *cache = nullptr,
+                                  const texture_options &options = {});
+        /* bytes of pcData */
+        static std::size_t embedded_size(const aiTexture *texture);
+        static bool write_embedded_texture(const aiTexture *texture,
+                                           const std::filesystem::path &path,
+                                           texture_cache *cache = nullptr,
+                                           const texture_options &options
+                                           = {});
 };
 
-std::ostream &operator<<(std::ostream &stream, const better_float &fl);
 std::ostream &operator<<(std::ostream &stream, const aiColor3D &color);
 std::ostream &operator<<(std::ostream &stream, const aiColor4D &color);
 std::ostream &operator<<(std::ostream &stream, const aiVector3D &vec);
 std::ostream &operator<<(std::ostream &stream, const aiVector3D &vec);
-std::ostream &operator<<(std::ostream &stream,
-                         const math::vector<float, 2> &vec);
-std::ostream &operator<<(std::ostream &stream,
-                         const math::vector<float, 3> &vec);
 #endif
@@ -0,0 +1,144 @@
+#ifndef DIRECTIVES_HH
+#define DIRECTIVES_HH
+
+#include "format.hh"
+#include <cstddef>
+#include <string>
+
+const static std::string SEPARATOR = " ";
+const static std::string COMMENT_DIRECTIVE = "#";
+const static std::string COMMENT = COMMENT_DIRECTIVE + SEPARATOR;
+const static std::string CAMERA_DIRECTIVE = "C";
+const static std::string AMBIENT_LIGHT_DIRECTIVE = "A";
+const static std::string AMBIENT_LIGHT_DEFAULT_BRIGHTNESS = "";
+const static std::string POINT_LIGHT_DIRECTIVE = "l";
+const static std::string TEX_DIRECTIVE = "tex_def";
+const static std::string MAT_USE_DIRECTIVE = "mat_use";
+const static std::string MAT_BEGIN_DIRECTIVE = "mat_beg";
+const static std::string MAT_PREFIX = "mat_";
+const static std::string MAT_INDENT = "    ";
+const static std::string MAT_DIFFUSE_DIRECTIVE = "diffuse";
+const static std::string MAT_EMISSIVE_DIRECTIVE = "emission";
+const static std::string MAT_OPACITY_DIRECTIVE = "alpha";
+const static std::string MAT_SPECULAR_DIRECTIVE = "specular";
+const static std::string MAT_GLOSSY_DIRECTIVE = "phong";
+const static std::string MAT_SPECULAR_DEFAULT_FUZZY = "0.5";
+const static std::string MAT_DEFAULT_BRIGHTNESS = "1.0";
+const static std::string BXDF_DEFAULT_WEIGHT = "1.0";
+const static std::string MAT_FILTER = "filter";
+const static std::string MAT_SMOOTH_DIRECTIVE = "smooth";
+const static std::string MAT_END_DIRECTIVE = "mat_end";
+const static std::string TEX_PREFIX = "tex_";
+const static std::string EMBEDDED_TEX_PREFIX = "embedded";
+const static std::string TEX_EXT = ".bmp";
+const static std::string MIP_TEX_EXT = ".jmip";
+const static std::string FACE_DIRECTIVE = "f";
+const static std::string VTN_DIRECTIVE = "x";
+const static std::string VT_DIRECTIVE = "w";
+const static std::string VN_DIRECTIVE = "y";
+const static std::string V_DIRECTIVE = "v";
+const static std::string MESH_BEGIN_DIRECTIVE = "mesh_beg";
+const static std::string MESH_END_DIRECTIVE = "mesh_end";
+const static std::string MESH_PREFIX = "mesh_";
+const static std::string INSTANCE_DIRECTIVE = "inst";
+
+const static std::string DEFAULT_CAMERA
+    = CAMERA_DIRECTIVE + SEPARATOR + "0,0,0 1,0,0 90";
+
+/*
+  the directives below are shared by every writer of mesh data, so that the
+  text form can always be reproduced exactly from any other output form.
+*/
+inline void write_mat_use_directive(text_buffer &stream,
+                                    const std::string &material) {
+        stream << MAT_USE_DIRECTIVE << SEPARATOR << MAT_PREFIX << material
+               << '\n';
+}
+
+/* the attributes a vertex directive carries besides its position, a
+ * mesh uses the narrowest directive that holds everything it has */
+constexpr unsigned int VERTEX_UV = 1 << 0;
+constexpr unsigned int VERTEX_NORMAL = 1 << 1;
+constexpr unsigned int VERTEX_UV_NORMAL = VERTEX_UV | VERTEX_NORMAL;
+
+/* decimals written for every vertex attribute, see better_float */
+struct vertex_precision {
+        int point = better_float::DEFAULT_PRECISION;
+        int uv = better_float::DEFAULT_PRECISION;
+        int normal = better_float::DEFAULT_PRECISION;
+        /* bits per axis of the octahedral grid that normals are snapped to
+         * before they are written, zero writes them as they are */
+        int normal_bits = 0;
+};
+
+template <std::size_t N>
+inline void write_components(text_buffer &stream,
+                             const math::vector<float, N> &vec,
+                             int precision) {
+        stream << better_float(vec[0], precision);
+        for (std::size_t idx = 1; idx < N; ++idx)
+                stream << ',' << better_float(vec[idx], precision);
+}
+
+inline void write_vertex_directive(text_buffer &stream,
+                                   unsigned int attributes,
+                                   const math::vector<float, 3> &point,
+                                   const math::vector<float, 2> &uv,
+                                   const math::vector<float, 3> &normal,
+                                   const vertex_precision &precision = {}) {
+        switch (attributes & VERTEX_UV_NORMAL) {
+        case VERTEX_UV_NORMAL:
+                stream << VTN_DIRECTIVE;
+                break;
+        case VERTEX_UV:
+                stream << VT_DIRECTIVE;
+                break;
+        case VERTEX_NORMAL:
+                stream << VN_DIRECTIVE;
+                break;
+        default:
+                stream << V_DIRECTIVE;
+        }
+        stream << SEPARATOR;
+        write_components(stream, point, precision.point);
+        if (attributes & VERTEX_UV) {
+                stream << SEPARATOR;
+                write_components(stream, uv, precision.uv);
+        }
+        if (attributes & VERTEX_NORMAL) {
+                stream << SEPARATOR;
+                write_components(stream, normal, precision.normal);
+        }
+        stream << '\n';
+}
+
+/* faces inside a mesh block index the vertices of that block only */
+inline void write_mesh_begin_directive(text_buffer &stream, std::size_t mesh) {
+        stream << MESH_BEGIN_DIRECTIVE << SEPARATOR << MESH_PREFIX << mesh
+               << '\n';
+}
+
+inline void write_mesh_end_directive(text_buffer &stream) {
+        stream << MESH_END_DIRECTIVE << '\n';
+}
+
+/* the top three rows of a row major affine matrix */
+using instance_transform = math::vector<math::vector<float, 4>, 3>;
+
+inline void write_instance_directive(text_buffer &stream, std::size_t mesh,
+                                     const instance_transform &transform) {
+        stream << INSTANCE_DIRECTIVE << SEPARATOR << MESH_PREFIX << mesh;
+        for (const math::vector<float, 4> &row : transform) {
+                stream << SEPARATOR << better_float(row[0]) << ','
+                       << better_float(row[1]) << ',' << better_float(row[2])
+                       << ',' << better_float(row[3]);
+        }
+        stream << '\n';
+}
+
+inline void write_face_directive(text_buffer &stream, std::size_t a,
+                                 std::size_t b, std::size_t c) {
+        stream << FACE_DIRECTIVE << SEPARATOR << a << SEPARATOR << b
+               << SEPARATOR << c << '\n';
+}
+#endif
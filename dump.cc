@@ -0,0 +1,24 @@
+#include "binary_scene.hh"
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+/*
+  prints a binary scene in its text form, so it can be compared against the
+  text output of juc for the same model.
+*/
+int main(int argc, char *argv[]) {
+        if (argc != 2) {
+                std::cerr << argv[0] << " <binary scene>" << std::endl;
+                return EXIT_FAILURE;
+        }
+        try {
+                const binary_scene scene(argv[1]);
+                scene.write_text(std::cout);
+                std::cout.flush();
+        } catch (const std::exception &ex) {
+                std::cerr << argv[0] << ": " << ex.what() << std::endl;
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#include "format.hh"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+char *to_chars(char *first, char *last, const better_float &fl) noexcept {
+        const std::to_chars_result result
+            = fl.precision() < 0
+                  ? std::to_chars(first, last, fl.value(),
+                                  std::chars_format::fixed)
+                  : std::to_chars(first, last, fl.value(),
+                                  std::chars_format::fixed, fl.precision());
+        char *end = result.ptr;
+        if (std::find(first, end, '.') == end)
+                return end;
+        while (end != first && end[-1] == '0')
+                --end;
+        if (end != first && end[-1] == '.')
+                --end;
+        return end;
+}
+
+text_buffer::text_buffer(text_buffer &&other) noexcept
+    : _data(std::move(other._data)), _size(other._size),
+      _capacity(other._capacity) {
+        other._size = 0;
+        other._capacity = 0;
+}
+
+text_buffer &text_buffer::operator=(text_buffer &&other) noexcept {
+        if (this != &other) {
+                _data = std::move(other._data);
+                _size = other._size;
+                _capacity = other._capacity;
+                other._size = 0;
+                other._capacity = 0;
+        }
+        return *this;
+}
+
+void text_buffer::reserve(std::size_t capacity) {
+        if (capacity <= _capacity)
+                return;
+        std::unique_ptr<char[]> data(new char[capacity]);
+        if (_size != 0)
+                std::memcpy(data.get(), _data.get(), _size);
+        _data = std::move(data);
+        _capacity = capacity;
+}
+
+void text_buffer::grow(std::size_t count) {
+        reserve(std::max(_size + count, _capacity * 2));
+}
+
+void text_buffer::append(const char *str, std::size_t count) {
+        std::memcpy(prepare(count), str, count);
+        _size += count;
+}
+
+text_buffer &text_buffer::operator<<(const better_float &fl) {
+        char *const first = prepare(better_float::MAX_CHARS);
+        commit(to_chars(first, first + better_float::MAX_CHARS, fl));
+        return *this;
+}
+
+text_buffer &text_buffer::operator<<(const math::vector<float, 2> &vec) {
+        return *this << better_float(vec[0]) << ',' << better_float(vec[1]);
+}
+
+text_buffer &text_buffer::operator<<(const math::vector<float, 3> &vec) {
+        return *this << better_float(vec[0]) << ',' << better_float(vec[1])
+                     << ',' << better_float(vec[2]);
+}
+
+std::ostream &operator<<(std::ostream &stream, const better_float &fl) {
+        char buf[better_float::MAX_CHARS];
+        return stream.write(buf, to_chars(buf, buf + sizeof(buf), fl) - buf);
+}
+
+std::ostream &operator<<(std::ostream &stream,
+                         const math::vector<float, 2> &vec) {
+        return stream << better_float(vec[0]) << "," << better_float(vec[1]);
+}
+
+std::ostream &operator<<(std::ostream &stream,
+                         const math::vector<float, 3> &vec) {
+        return stream << better_float(vec[0]) << "," << better_float(vec[1])
+                      << "," << better_float(vec[2]);
+}
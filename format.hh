@@ -0,0 +1,112 @@
+#ifndef FORMAT_HH
+#define FORMAT_HH
+
+#include <array>
+#include <charconv>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string_view>
+
+namespace math {
+template <typename T, std::size_t N> using vector = std::array<T, N>;
+}
+
+/*
+  a float that is printed in fixed notation with its trailing zeros (and a
+  trailing dot) removed. a negative precision prints the shortest
+  representation that round-trips back to the same float.
+*/
+class better_float {
+        float _val;
+        int _precision;
+
+      public:
+        static constexpr int DEFAULT_PRECISION = 6;
+        static constexpr int SHORTEST = -1;
+        /* enough room for -FLT_MAX in fixed notation with any precision we
+         * use */
+        static constexpr std::size_t MAX_CHARS = 64;
+
+        constexpr better_float(float val,
+                               int precision = DEFAULT_PRECISION) noexcept
+            : _val(val), _precision(precision) {}
+        constexpr float value() const noexcept { return _val; }
+        constexpr int precision() const noexcept { return _precision; }
+};
+
+/*
+  writes fl into [first, last) and returns one past the last character
+  written. the range must be at least better_float::MAX_CHARS long.
+*/
+char *to_chars(char *first, char *last, const better_float &fl) noexcept;
+
+/*
+  growable character buffer that the formatting functions write into
+  directly, so that no temporary streams or strings are needed per value.
+*/
+class text_buffer {
+        std::unique_ptr<char[]> _data;
+        std::size_t _size = 0;
+        std::size_t _capacity = 0;
+
+      public:
+        text_buffer() = default;
+        text_buffer(const text_buffer &other) = delete;
+        text_buffer(text_buffer &&other) noexcept;
+        ~text_buffer() = default;
+
+        text_buffer &operator=(const text_buffer &other) = delete;
+        text_buffer &operator=(text_buffer &&other) noexcept;
+
+        inline const char *data() const noexcept { return _data.get(); }
+        inline std::size_t size() const noexcept { return _size; }
+        inline bool empty() const noexcept { return _size == 0; }
+        inline std::string_view view() const noexcept {
+                return std::string_view(_data.get(), _size);
+        }
+        inline void clear() noexcept { _size = 0; }
+
+        void reserve(std::size_t capacity);
+
+        /* returns room for at least count more characters, which become
+         * part of the buffer once commit is called */
+        inline char *prepare(std::size_t count) {
+                if (_capacity - _size < count)
+                        grow(count);
+                return _data.get() + _size;
+        }
+        inline void commit(char *end) noexcept { _size = end - _data.get(); }
+
+        void append(const char *str, std::size_t count);
+
+        inline text_buffer &operator<<(std::string_view str) {
+                append(str.data(), str.size());
+                return *this;
+        }
+        inline text_buffer &operator<<(char ch) {
+                *prepare(1) = ch;
+                _size += 1;
+                return *this;
+        }
+        template <std::integral T> text_buffer &operator<<(T value) {
+                /* 20 digits and a sign cover any 64 bit integer */
+                char *const first = prepare(21);
+                commit(std::to_chars(first, first + 21, value).ptr);
+                return *this;
+        }
+        text_buffer &operator<<(const better_float &fl);
+        text_buffer &operator<<(const math::vector<float, 2> &vec);
+        text_buffer &operator<<(const math::vector<float, 3> &vec);
+
+      private:
+        void grow(std::size_t count);
+};
+
+std::ostream &operator<<(std::ostream &stream, const better_float &fl);
+std::ostream &operator<<(std::ostream &stream,
+                         const math::vector<float, 2> &vec);
+std::ostream &operator<<(std::ostream &stream,
+                         const math::vector<float, 3> &vec);
+#endif
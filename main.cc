@@ -1,16 +1,128 @@
 #include "converter.hh"
+#include <algorithm>
 #include <boost/program_options.hpp>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/* anything finer than a float can hold is only longer */
+const static int MAX_PRECISION = 9;
+const static int MAX_NORMAL_BITS = 23;
+const static std::string OUTPUT_EXT = ".rt";
+
+/* a model to convert and where to put it, standard output if nowhere */
+struct job {
+        std::filesystem::path input;
+        std::string name;
+        std::optional<std::filesystem::path> output;
+};
+
+/* a converter together with the output it writes to */
+struct conversion {
+        std::unique_ptr<output_file> file;
+        std::fstream stream;
+        std::unique_ptr<converter> conv;
+};
 
 void print_usage(const std::string &name) {
         std::cerr << name << " <model>" << std::endl;
 }
 
+/* scene.rt becomes scene.lod1.rt */
+std::filesystem::path lod_path(const std::filesystem::path &path,
+                               std::size_t level) {
+        std::filesystem::path result = path;
+        return result.replace_extension(".lod" + std::to_string(level)
+                                        + path.extension().string());
+}
+
+/* scene.rt gets its bvh in scene.bvh */
+void write_bvh(converter &conv, const std::filesystem::path &path) {
+        std::filesystem::path bvh_path = path;
+        std::ofstream file(bvh_path.replace_extension(".bvh"),
+                           std::ios::out | std::ios::binary);
+        conv.write_bvh(file);
+}
+
+void write_lod(converter &conv, const std::filesystem::path &path,
+               double ratio) {
+        if (output_file::supports(path)) {
+                const output_file file(path);
+                conv.convert_lod(file, ratio);
+        } else {
+                std::fstream file(path, std::ios::out | std::ios::binary);
+                conv.convert_lod(file, ratio);
+        }
+}
+
+/* the models listed in path, one per line, relative to its directory.
+ * empty lines and lines starting with # are skipped */
+std::vector<std::filesystem::path>
+read_manifest(const std::filesystem::path &path) {
+        std::ifstream file(path);
+        if (!file)
+                throw std::runtime_error(path.string()
+                                         + ": could not open manifest");
+        std::vector<std::filesystem::path> result;
+        std::string line;
+        while (std::getline(file, line)) {
+                if (line.empty() || line.starts_with("#"))
+                        continue;
+                result.push_back(path.parent_path() / line);
+        }
+        return result;
+}
+
+/* imports the model of job, which is most of the work before anything
+ * can be written */
+std::unique_ptr<conversion> open_conversion(const job &job,
+                                            const converter_options &options) {
+        auto result = std::make_unique<conversion>();
+        const std::string input = job.input.string();
+        if (!job.output) {
+                result->conv = std::make_unique<converter>(input, std::cout,
+                                                           job.name, options);
+        } else if (output_file::supports(*job.output)) {
+                /* regular files are written by every worker at once,
+                 * anything else goes through a stream */
+                result->file = std::make_unique<output_file>(*job.output);
+                result->conv = std::make_unique<converter>(
+                    input, *result->file, job.name, options);
+        } else {
+                result->stream.open(*job.output,
+                                    std::ios::out | std::ios::binary);
+                result->conv = std::make_unique<converter>(
+                    input, result->stream, job.name, options);
+        }
+        return result;
+}
+
+void run_conversion(conversion &conv, const job &job, bool bvh,
+                    const std::vector<double> &lods) {
+        conv.conv->convert();
+        if (!job.output)
+                return;
+        if (bvh)
+                write_bvh(*conv.conv, *job.output);
+        for (std::size_t idx = 0; idx < lods.size(); ++idx) {
+                const std::filesystem::path path
+                    = lod_path(*job.output, idx + 1);
+                write_lod(*conv.conv, path, lods[idx]);
+                if (bvh)
+                        write_bvh(*conv.conv, path);
+        }
+}
+
 int main(int argc, char *argv[]) {
         namespace po = boost::program_options;
         namespace fs = std::filesystem;
@@ -21,13 +133,95 @@ int main(int argc, char *argv[]) {
         // add option to flip triangulation
         // check if input file exists, because assimp doesn't check that
         desc.add_options()("help,h", "produce a help message")(
-            "input-file,i", po::value<fs::path>(),
-            "specify the model to convert")(
+            "input-file,i", po::value<std::vector<fs::path>>(),
+            "specify the models to convert")(
+            "manifest", po::value<fs::path>(),
+            "also convert the models listed in the given file, one per "
+            "line")(
             "output-file,o", po::value<std::string>(),
             "specify the file to put the output in")(
+            "output-dir", po::value<fs::path>(),
+            "write every model to <dir>/<name>.rt, needed to convert more "
+            "than one model")(
             "name,n", po::value<std::string>(),
             "specify the name to give to the converted scene file")(
-            "smooth,-s", "generate smooth normals");
+            "smooth,-s", "generate smooth normals")(
+            "native-postprocess",
+            "generate smooth normals and join identical vertices on the "
+            "worker threads instead of in assimp")(
+            "native-import",
+            "read obj and binary ply files on the worker threads instead "
+            "of with assimp")(
+            "format,f", po::value<std::string>()->default_value("text"),
+            "specify the output format, either text or binary")(
+            "compress", po::value<std::string>(),
+            "compress text output with gzip or zstd, optionally followed by "
+            "a level as in zstd:19")(
+            "precision-pos", po::value<int>(),
+            "number of decimals to write vertex positions with")(
+            "precision-uv", po::value<int>(),
+            "number of decimals to write texture coordinates with")(
+            "precision-normal", po::value<int>(),
+            "number of decimals to write normals with")(
+            "octahedral-normals", po::value<int>(),
+            "snap normals to the directions an octahedral encoding with the "
+            "given number of bits per axis can represent")(
+            "weld", "merge identical vertices across all meshes")(
+            "weld-epsilon", po::value<float>(),
+            "merge vertices whose attributes differ by less than the given "
+            "distance, implies --weld")(
+            "instance",
+            "write every mesh once and every node using it as an instance "
+            "instead of flattening the scene")(
+            "target-triangles", po::value<std::size_t>(),
+            "simplify the meshes until the scene has about the given number "
+            "of triangles")(
+            "dedup",
+            "write textures with the same content and materials with the "
+            "same properties only once")(
+            "reorder",
+            "sort the faces and vertices of every mesh so that ones close "
+            "in the output are close in space")(
+            "lod", po::value<std::vector<double>>()->multitoken(),
+            "also write the scene with its meshes simplified to each of the "
+            "given fractions of their triangles, with .lod<n> before the "
+            "extension of the output as in scene.lod1.rt")(
+            "bvh",
+            "also write a bounding volume hierarchy over the triangles of "
+            "every output, with the extension of the output replaced by "
+            ".bvh as in scene.bvh")(
+            "grain", po::value<std::size_t>()->default_value(65536),
+            "number of vertices or faces of a mesh to format per task")(
+            "threads,j", po::value<std::size_t>()->default_value(0),
+            "number of worker threads, 0 uses every hardware thread")(
+            "texture-format", po::value<std::string>()->default_value("bmp"),
+            "specify the texture format, either bmp or mip for a mipmapped "
+            "texture that can be mapped in place")(
+            "tiled-textures", "store the levels of mip textures in tiles")(
+            "max-texture-size", po::value<std::size_t>(),
+            "scale textures down until neither side is larger than the "
+            "given number of texels")(
+            "texture-cache",
+            po::value<fs::path>()->implicit_value(
+                texture_cache::default_directory()),
+            "keep converted textures in the given directory between runs")(
+            "texture-cache-size",
+            po::value<std::uintmax_t>()->default_value(4096),
+            "maximum size of the texture cache in MiB")(
+            "incremental", po::value<fs::path>(),
+            "keep the formatted meshes in the given directory and reuse the "
+            "unchanged ones on the next run, converted textures are kept "
+            "there too unless --texture-cache is given")(
+            "max-buffered", po::value<std::size_t>()->default_value(256),
+            "maximum amount of formatted output in MiB to hold in memory "
+            "while waiting for earlier meshes")(
+            "memory-budget", po::value<std::size_t>(),
+            "memory in MiB the formatted output may take up, meshes wait to "
+            "be formatted until there is room, --max-buffered is lowered to "
+            "half of it")(
+            "stats", po::value<fs::path>(),
+            "write timings and counters of the conversion as json to the "
+            "given file");
 
         pdesc.add("input-file", -1);
 
@@ -48,37 +242,283 @@ int main(int argc, char *argv[]) {
                 std::cout << desc << std::endl;
                 return EXIT_SUCCESS;
         }
-        if (vm.count("input-file") == 0) {
+        std::vector<fs::path> inputs;
+        if (vm.count("input-file"))
+                inputs = vm["input-file"].as<std::vector<fs::path>>();
+        if (vm.count("manifest")) {
+                try {
+                        const std::vector<fs::path> listed
+                            = read_manifest(vm["manifest"].as<fs::path>());
+                        inputs.insert(inputs.end(), listed.begin(),
+                                      listed.end());
+                } catch (const std::exception &ex) {
+                        std::cerr << argv[0] << ": " << ex.what()
+                                  << std::endl;
+                        return EXIT_FAILURE;
+                }
+        }
+        if (inputs.empty()) {
                 std::cerr << argv[0] << ": no input file specified"
                           << std::endl;
                 return EXIT_FAILURE;
         }
-        const fs::path in_file = vm["input-file"].as<fs::path>();
-        if (!fs::exists(in_file)) {
-                std::cerr << argv[0] << ": " << in_file.string()
-                          << ": does not exist" << std::endl;
+        if (inputs.size() > 1
+            && (vm.count("output-dir") == 0 || vm.count("name"))) {
+                std::cerr << argv[0] << ": more than one model needs "
+                          << "--output-dir and no --name" << std::endl;
                 return EXIT_FAILURE;
-        } else if (fs::status(in_file).type() == fs::file_type::directory) {
-                std::cerr << argv[0] << ": " << in_file.string()
-                          << ": is a directory" << std::endl;
+        }
+        if (vm.count("output-file") && vm.count("output-dir")) {
+                std::cerr << argv[0] << ": --output-file and --output-dir "
+                          << "can not be combined" << std::endl;
                 return EXIT_FAILURE;
         }
-        std::string name = in_file.stem();
-        if (vm.count("name")) {
-                name = vm["name"].as<std::string>();
+        std::vector<job> jobs;
+        std::unordered_set<std::string> names;
+        for (const fs::path &in_file : inputs) {
+                if (!fs::exists(in_file)) {
+                        std::cerr << argv[0] << ": " << in_file.string()
+                                  << ": does not exist" << std::endl;
+                        return EXIT_FAILURE;
+                } else if (fs::status(in_file).type()
+                           == fs::file_type::directory) {
+                        std::cerr << argv[0] << ": " << in_file.string()
+                                  << ": is a directory" << std::endl;
+                        return EXIT_FAILURE;
+                }
+                job entry = { in_file, in_file.stem(), std::nullopt };
+                if (vm.count("name"))
+                        entry.name = vm["name"].as<std::string>();
+                /* the textures of a model go in a directory named after
+                 * it, so two models can not have the same name */
+                if (!names.insert(entry.name).second) {
+                        std::cerr << argv[0] << ": " << in_file.string()
+                                  << ": another model is named "
+                                  << entry.name << std::endl;
+                        return EXIT_FAILURE;
+                }
+                if (vm.count("output-file"))
+                        entry.output = vm["output-file"].as<std::string>();
+                else if (vm.count("output-dir"))
+                        entry.output = vm["output-dir"].as<fs::path>()
+                                       / (entry.name + OUTPUT_EXT);
+                jobs.push_back(std::move(entry));
+        }
+        const bool has_output = jobs.front().output.has_value();
+        converter_options options;
+        options.smooth = vm.count("smooth") != 0;
+        options.native_postprocess = vm.count("native-postprocess") != 0;
+        options.native_import = vm.count("native-import") != 0;
+        options.max_buffered = vm["max-buffered"].as<std::size_t>() << 20;
+        options.grain = vm["grain"].as<std::size_t>();
+        options.threads = vm["threads"].as<std::size_t>();
+        if (vm.count("texture-cache"))
+                options.texture_cache = vm["texture-cache"].as<fs::path>();
+        options.texture_cache_size
+            = vm["texture-cache-size"].as<std::uintmax_t>() << 20;
+        const std::pair<const char *, int *> precisions[]
+            = { { "precision-pos", &options.precision.point },
+                { "precision-uv", &options.precision.uv },
+                { "precision-normal", &options.precision.normal } };
+        for (const auto &[option, precision] : precisions) {
+                if (vm.count(option) == 0)
+                        continue;
+                *precision = vm[option].as<int>();
+                if (*precision < 0 || *precision > MAX_PRECISION) {
+                        std::cerr << argv[0] << ": --" << option
+                                  << " must be between 0 and "
+                                  << MAX_PRECISION << std::endl;
+                        return EXIT_FAILURE;
+                }
         }
+        if (vm.count("octahedral-normals")) {
+                options.precision.normal_bits
+                    = vm["octahedral-normals"].as<int>();
+                if (options.precision.normal_bits < 2
+                    || options.precision.normal_bits > MAX_NORMAL_BITS) {
+                        std::cerr << argv[0]
+                                  << ": --octahedral-normals must be between "
+                                  << "2 and " << MAX_NORMAL_BITS << std::endl;
+                        return EXIT_FAILURE;
+                }
+        }
+        options.weld = vm.count("weld") != 0 || vm.count("weld-epsilon") != 0;
+        if (vm.count("weld-epsilon"))
+                options.weld_epsilon = vm["weld-epsilon"].as<float>();
+        options.instance = vm.count("instance") != 0;
+        options.reorder = vm.count("reorder") != 0;
+        options.dedup = vm.count("dedup") != 0;
+        if (vm.count("target-triangles"))
+                options.target_triangles
+                    = vm["target-triangles"].as<std::size_t>();
+        std::vector<double> lods;
+        if (vm.count("lod")) {
+                lods = vm["lod"].as<std::vector<double>>();
+                /* every level is simplified from the one before it */
+                std::sort(lods.begin(), lods.end(), std::greater<double>());
+                if (lods.back() <= 0.0 || lods.front() >= 1.0) {
+                        std::cerr << argv[0]
+                                  << ": lod fractions must be between 0 and 1"
+                                  << std::endl;
+                        return EXIT_FAILURE;
+                }
+                if (!has_output) {
+                        std::cerr << argv[0]
+                                  << ": lod levels need an output file"
+                                  << std::endl;
+                        return EXIT_FAILURE;
+                }
+        }
+        const bool bvh = vm.count("bvh") != 0;
+        if (bvh && !has_output) {
+                std::cerr << argv[0] << ": a bvh needs an output file"
+                          << std::endl;
+                return EXIT_FAILURE;
+        }
+        if (bvh && options.instance) {
+                std::cerr << argv[0] << ": a bvh can not be built for "
+                          << "instanced output" << std::endl;
+                return EXIT_FAILURE;
+        }
+        /* nothing needs the geometry of a mesh after it is written unless
+         * it is simplified or built into a bvh afterwards */
+        options.release_geometry = lods.empty() && !bvh;
+        if (vm.count("memory-budget"))
+                options.memory_budget = vm["memory-budget"].as<std::size_t>()
+                                        << 20;
+        const std::string format = vm["format"].as<std::string>();
+        if (format == "binary") {
+                options.format = output_format::binary;
+        } else if (format != "text") {
+                std::cerr << argv[0] << ": " << format
+                          << ": unknown output format" << std::endl;
+                return EXIT_FAILURE;
+        }
+        const std::string tex_format
+            = vm["texture-format"].as<std::string>();
+        if (tex_format == "mip") {
+                options.textures.format = texture_format::mip;
+        } else if (tex_format != "bmp") {
+                std::cerr << argv[0] << ": " << tex_format
+                          << ": unknown texture format" << std::endl;
+                return EXIT_FAILURE;
+        }
+        options.textures.tiled = vm.count("tiled-textures") != 0;
+        if (options.textures.tiled
+            && options.textures.format != texture_format::mip) {
+                std::cerr << argv[0] << ": only mip textures can be tiled"
+                          << std::endl;
+                return EXIT_FAILURE;
+        }
+        if (vm.count("max-texture-size")) {
+                options.textures.max_size
+                    = vm["max-texture-size"].as<std::size_t>();
+                if (options.textures.max_size == 0) {
+                        std::cerr << argv[0]
+                                  << ": --max-texture-size must be at least 1"
+                                  << std::endl;
+                        return EXIT_FAILURE;
+                }
+        }
+        if (vm.count("compress")) {
+                try {
+                        options.compress = parse_compression(
+                            vm["compress"].as<std::string>());
+                } catch (const std::exception &ex) {
+                        std::cerr << argv[0] << ": " << ex.what()
+                                  << std::endl;
+                        return EXIT_FAILURE;
+                }
+                /* a compressed binary scene could not be mapped */
+                if (options.format == output_format::binary) {
+                        std::cerr << argv[0] << ": compression is only "
+                                  << "supported for text output" << std::endl;
+                        return EXIT_FAILURE;
+                }
+        }
+        std::unique_ptr<chunk_store> chunks;
+        if (vm.count("incremental")) {
+                if (options.weld) {
+                        std::cerr << argv[0] << ": incremental conversion is "
+                                  << "not supported with welding"
+                                  << std::endl;
+                        return EXIT_FAILURE;
+                }
+                const fs::path dir = vm["incremental"].as<fs::path>();
+                try {
+                        chunks = std::make_unique<chunk_store>(dir);
+                } catch (const std::exception &ex) {
+                        std::cerr << argv[0] << ": " << ex.what()
+                                  << std::endl;
+                        return EXIT_FAILURE;
+                }
+                options.chunks = chunks.get();
+                if (!options.texture_cache)
+                        options.texture_cache = dir / "textures";
+        }
+        std::unique_ptr<stats> report;
+        if (vm.count("stats")) {
+                report = std::make_unique<stats>(
+                    jobs.size() == 1
+                        ? jobs.front().input.string()
+                        : std::to_string(jobs.size()) + " models");
+                options.statistics = report.get();
+        }
+        /* every model runs on the same pool and converts the textures it
+         * shares with an earlier one only once */
+        scheduler pool(options.threads, options.statistics);
+        if (report)
+                report->threads = pool.size();
+        texture_table textures;
+        options.pool = &pool;
+        options.shared_textures = &textures;
+        if (vm.count("output-dir")) {
+                const fs::path dir = vm["output-dir"].as<fs::path>();
+                std::error_code error;
+                fs::create_directories(dir, error);
+                if (error) {
+                        std::cerr << argv[0] << ": " << dir.string() << ": "
+                                  << error.message() << std::endl;
+                        return EXIT_FAILURE;
+                }
+        }
+        bool failed = false;
+        /* the next model is imported while the current one is written.
+         * assimp imports on the thread of the future alone, the native
+         * importers parse on the shared pool and take workers from the
+         * current model while they run */
+        std::future<std::unique_ptr<conversion>> next
+            = std::async(std::launch::async, open_conversion,
+                         std::cref(jobs.front()), std::cref(options));
+        for (std::size_t idx = 0; idx < jobs.size(); ++idx) {
+                std::future<std::unique_ptr<conversion>> current
+                    = std::move(next);
+                if (idx + 1 < jobs.size())
+                        next = std::async(std::launch::async,
+                                          open_conversion,
+                                          std::cref(jobs[idx + 1]),
+                                          std::cref(options));
+                try {
+                        run_conversion(*current.get(), jobs[idx], bvh, lods);
+                } catch (const std::exception &ex) {
+                        std::cerr << argv[0] << ": "
+                                  << jobs[idx].input.string() << ": "
+                                  << ex.what() << std::endl;
+                        failed = true;
+                }
+        }
+        if (failed)
+                return EXIT_FAILURE;
         try {
-                if (vm.count("output-file")) {
-                        std::fstream out_file
-                            = std::fstream(vm["output-file"].as<std::string>(),
-                                           std::ios::out);
-                        converter conv(in_file.string(), out_file, name,
-                                       vm.count("smooth") != 0);
-                        conv.convert();
-                } else {
-                        converter conv(in_file.string(), std::cout, name,
-                                       vm.count("smooth") != 0);
-                        conv.convert();
+                /* only a complete run replaces the chunks of the last one */
+                if (chunks)
+                        chunks->commit();
+                if (report) {
+                        std::ofstream stats_file(vm["stats"].as<fs::path>());
+                        report->write_json(stats_file);
+                        if (!stats_file)
+                                throw std::runtime_error(
+                                    "could not write stats");
                 }
         } catch (const std::exception &ex) {
                 std::cout << argv[0] << ": " << ex.what() << std::endl;
@@ -0,0 +1,44 @@
+#include "mapped_file.hh"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_file::mapped_file(const std::filesystem::path &path)
+    : _data(nullptr), _size(0), path(path) {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                throw std::runtime_error(path.string() + ": "
+                                         + std::strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                close(fd);
+                throw std::runtime_error(path.string()
+                                         + ": is not a regular file");
+        }
+        _size = st.st_size;
+        /* an empty mapping is not allowed, an empty file has no data */
+        if (_size != 0) {
+                void *const data
+                    = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED) {
+                        const int error = errno;
+                        close(fd);
+                        throw std::runtime_error(path.string() + ": "
+                                                 + std::strerror(error));
+                }
+                _data = static_cast<const char *>(data);
+                /* every chunk is read front to back */
+                madvise(data, _size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+}
+
+mapped_file::~mapped_file() {
+        if (_data != nullptr)
+                munmap(const_cast<char *>(_data), _size);
+}
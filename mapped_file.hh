@@ -0,0 +1,30 @@
+#ifndef MAPPED_FILE_HH
+#define MAPPED_FILE_HH
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+/*
+  a regular file mapped read only into memory, so it can be parsed by
+  several threads at once without reading it into a buffer first. the
+  pages are only read in as they are touched.
+*/
+class mapped_file {
+        const char *_data;
+        std::size_t _size;
+
+      public:
+        const std::filesystem::path path;
+
+        mapped_file() = delete;
+        explicit mapped_file(const std::filesystem::path &path);
+        mapped_file(const mapped_file &other) = delete;
+        ~mapped_file();
+
+        mapped_file &operator=(const mapped_file &other) = delete;
+
+        inline std::string_view contents() const { return { _data, _size }; }
+};
+
+#endif
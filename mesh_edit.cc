@@ -0,0 +1,68 @@
+#include "mesh_edit.hh"
+#include <algorithm>
+
+namespace {
+template <typename T>
+void remap_array(T *&array, const std::vector<std::uint32_t> &remap,
+                 std::size_t count) {
+        if (array == nullptr)
+                return;
+        T *const result = new T[count];
+        for (std::size_t idx = 0; idx < remap.size(); ++idx) {
+                if (remap[idx] != NO_VERTEX)
+                        result[remap[idx]] = array[idx];
+        }
+        delete[] array;
+        array = result;
+}
+
+template <typename T> void release_array(T *&array) {
+        delete[] array;
+        array = nullptr;
+}
+}
+
+void remap_vertices(aiMesh *mesh, const std::vector<std::uint32_t> &remap,
+                    std::size_t count) {
+        remap_array(mesh->mVertices, remap, count);
+        remap_array(mesh->mNormals, remap, count);
+        remap_array(mesh->mTangents, remap, count);
+        remap_array(mesh->mBitangents, remap, count);
+        for (aiColor4D *&colors : mesh->mColors)
+                remap_array(colors, remap, count);
+        for (aiVector3D *&coords : mesh->mTextureCoords)
+                remap_array(coords, remap, count);
+        for (unsigned int idx = 0; idx < mesh->mNumBones; ++idx) {
+                aiBone *const bone = mesh->mBones[idx];
+                const auto last = std::remove_if(
+                    bone->mWeights, bone->mWeights + bone->mNumWeights,
+                    [&remap](const aiVertexWeight &weight) {
+                            return remap[weight.mVertexId] == NO_VERTEX;
+                    });
+                bone->mNumWeights = last - bone->mWeights;
+                std::for_each_n(bone->mWeights, bone->mNumWeights,
+                                [&remap](aiVertexWeight &weight) {
+                                        weight.mVertexId
+                                            = remap[weight.mVertexId];
+                                });
+        }
+        mesh->mNumVertices = count;
+}
+
+void release_geometry(aiMesh *mesh) {
+        release_array(mesh->mVertices);
+        release_array(mesh->mNormals);
+        release_array(mesh->mTangents);
+        release_array(mesh->mBitangents);
+        for (aiColor4D *&colors : mesh->mColors)
+                release_array(colors);
+        for (aiVector3D *&coords : mesh->mTextureCoords)
+                release_array(coords);
+        release_array(mesh->mFaces);
+        for (unsigned int idx = 0; idx < mesh->mNumBones; ++idx)
+                delete mesh->mBones[idx];
+        release_array(mesh->mBones);
+        mesh->mNumBones = 0;
+        mesh->mNumVertices = 0;
+        mesh->mNumFaces = 0;
+}
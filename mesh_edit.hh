@@ -0,0 +1,21 @@
+#ifndef MESH_EDIT_HH
+#define MESH_EDIT_HH
+
+#include <assimp/mesh.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const static std::uint32_t NO_VERTEX = std::uint32_t(-1);
+
+/* moves vertex idx of mesh to remap[idx] in every per vertex array and in
+ * the bone weights, dropping it when remap[idx] is NO_VERTEX. faces are
+ * left to the caller */
+void remap_vertices(aiMesh *mesh, const std::vector<std::uint32_t> &remap,
+                    std::size_t count);
+
+/* frees the vertices, faces and bones of mesh and leaves it empty, assimp
+ * can still destroy it afterwards */
+void release_geometry(aiMesh *mesh);
+
+#endif
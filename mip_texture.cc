@@ -0,0 +1,186 @@
+#include "mip_texture.hh"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+constexpr std::size_t COLOR_CHANNELS = 3;
+
+std::uint64_t mip_align(std::uint64_t offset) {
+        return (offset + MIP_ALIGNMENT - 1) & ~(MIP_ALIGNMENT - 1);
+}
+
+float srgb_to_linear(std::uint8_t value) {
+        static const std::array<float, 256> table = []() {
+                std::array<float, 256> result;
+                for (std::size_t idx = 0; idx < result.size(); ++idx) {
+                        const float srgb = idx / 255.0f;
+                        result[idx]
+                            = srgb <= 0.04045f
+                                  ? srgb / 12.92f
+                                  : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+                }
+                return result;
+        }();
+        return table[value];
+}
+
+std::uint8_t linear_to_srgb(float value) {
+        value = std::clamp(value, 0.0f, 1.0f);
+        const float srgb = value <= 0.0031308f
+                               ? value * 12.92f
+                               : 1.055f * std::pow(value, 1.0f / 2.4f)
+                                     - 0.055f;
+        return static_cast<std::uint8_t>(std::lround(srgb * 255.0f));
+}
+
+/* the source texels [begin, end) along one axis that texel idx of the
+ * smaller level covers, the last one also takes the odd texel */
+std::pair<std::uint32_t, std::uint32_t>
+source_range(std::uint32_t idx, std::uint32_t from, std::uint32_t to) {
+        const std::uint32_t begin = std::min(idx * 2, from - 1);
+        return { begin, idx + 1 == to ? from : begin + 2 };
+}
+
+mip_image downsample(const mip_image &from) {
+        mip_image to;
+        to.width = std::max<std::uint32_t>(from.width / 2, 1);
+        to.height = std::max<std::uint32_t>(from.height / 2, 1);
+        to.texels.resize(std::size_t(to.width) * to.height * MIP_TEXEL_SIZE);
+
+        auto out = to.texels.begin();
+        for (std::uint32_t y = 0; y < to.height; ++y) {
+                const auto [y_begin, y_end]
+                    = source_range(y, from.height, to.height);
+                for (std::uint32_t x = 0; x < to.width; ++x) {
+                        const auto [x_begin, x_end]
+                            = source_range(x, from.width, to.width);
+                        std::array<float, MIP_TEXEL_SIZE> sum = {};
+                        for (std::uint32_t sy = y_begin; sy < y_end; ++sy) {
+                                for (std::uint32_t sx = x_begin; sx < x_end;
+                                     ++sx) {
+                                        const std::uint8_t *texel
+                                            = &from.texels
+                                                   [(std::size_t(sy)
+                                                         * from.width
+                                                     + sx)
+                                                    * MIP_TEXEL_SIZE];
+                                        for (std::size_t c = 0;
+                                             c < COLOR_CHANNELS; ++c)
+                                                sum[c] += srgb_to_linear(
+                                                    texel[c]);
+                                        /* alpha is linear already */
+                                        sum[COLOR_CHANNELS]
+                                            += texel[COLOR_CHANNELS];
+                                }
+                        }
+                        const float count
+                            = float(y_end - y_begin) * (x_end - x_begin);
+                        for (std::size_t c = 0; c < COLOR_CHANNELS; ++c)
+                                *out++ = linear_to_srgb(sum[c] / count);
+                        *out++ = static_cast<std::uint8_t>(
+                            std::lround(sum[COLOR_CHANNELS] / count));
+                }
+        }
+        return to;
+}
+
+std::vector<std::uint8_t> tile_texels(const mip_image &level) {
+        const std::uint32_t tiles_x
+            = (level.width + MIP_TILE_SIZE - 1) / MIP_TILE_SIZE;
+        const std::uint32_t tiles_y
+            = (level.height + MIP_TILE_SIZE - 1) / MIP_TILE_SIZE;
+        std::vector<std::uint8_t> result(std::size_t(tiles_x) * tiles_y
+                                         * MIP_TILE_SIZE * MIP_TILE_SIZE
+                                         * MIP_TEXEL_SIZE);
+
+        auto out = result.begin();
+        for (std::uint32_t ty = 0; ty < tiles_y; ++ty) {
+                for (std::uint32_t tx = 0; tx < tiles_x; ++tx) {
+                        for (std::uint32_t y = 0; y < MIP_TILE_SIZE; ++y) {
+                                const std::uint32_t sy = std::min(
+                                    ty * MIP_TILE_SIZE + y, level.height - 1);
+                                for (std::uint32_t x = 0; x < MIP_TILE_SIZE;
+                                     ++x) {
+                                        const std::uint32_t sx
+                                            = std::min(tx * MIP_TILE_SIZE + x,
+                                                       level.width - 1);
+                                        out = std::copy_n(
+                                            level.texels.begin()
+                                                + (std::size_t(sy)
+                                                       * level.width
+                                                   + sx) * MIP_TEXEL_SIZE,
+                                            MIP_TEXEL_SIZE, out);
+                                }
+                        }
+                }
+        }
+        return result;
+}
+}
+
+std::vector<mip_image> build_mip_chain(mip_image image) {
+        if (image.width == 0 || image.height == 0)
+                throw std::runtime_error("can not mipmap an empty texture");
+        std::vector<mip_image> levels;
+        levels.push_back(std::move(image));
+        while (levels.back().width > 1 || levels.back().height > 1) {
+                mip_image next = downsample(levels.back());
+                levels.push_back(std::move(next));
+        }
+        return levels;
+}
+
+void write_mip_texture(std::ostream &stream,
+                       const std::vector<mip_image> &levels, bool tiled) {
+        const char zeros[MIP_ALIGNMENT] = {};
+        std::uint64_t offset = 0;
+        const auto put = [&stream, &offset](const void *data,
+                                            std::uint64_t size) {
+                stream.write(static_cast<const char *>(data), size);
+                offset += size;
+        };
+        const auto pad = [&put, &zeros, &offset](std::uint64_t to) {
+                put(zeros, to - offset);
+        };
+
+        std::vector<std::vector<std::uint8_t>> tiles;
+        if (tiled) {
+                for (const mip_image &level : levels)
+                        tiles.push_back(tile_texels(level));
+        }
+        const auto texels = [&levels, &tiles,
+                             tiled](std::size_t idx)
+            -> const std::vector<std::uint8_t> & {
+                return tiled ? tiles[idx] : levels[idx].texels;
+        };
+
+        mip_header header = {};
+        std::copy_n(MIP_MAGIC, sizeof(MIP_MAGIC), header.magic);
+        header.version = MIP_VERSION;
+        header.flags = tiled ? MIP_FLAG_TILED : 0;
+        header.width = levels.front().width;
+        header.height = levels.front().height;
+        header.level_count = levels.size();
+        header.tile_size = tiled ? MIP_TILE_SIZE : 0;
+
+        std::vector<mip_level> table(levels.size());
+        std::uint64_t end = sizeof(header) + table.size() * sizeof(mip_level);
+        for (std::size_t idx = 0; idx < levels.size(); ++idx) {
+                table[idx] = { { mip_align(end), texels(idx).size() },
+                               levels[idx].width,
+                               levels[idx].height };
+                end = table[idx].texels.offset + table[idx].texels.size;
+        }
+        header.file_size = end;
+
+        put(&header, sizeof(header));
+        put(table.data(), table.size() * sizeof(mip_level));
+        for (std::size_t idx = 0; idx < levels.size(); ++idx) {
+                pad(table[idx].texels.offset);
+                put(texels(idx).data(), table[idx].texels.size);
+        }
+        if (!stream)
+                throw std::runtime_error("could not write mipmapped texture");
+}
@@ -0,0 +1,65 @@
+#ifndef MIP_TEXTURE_HH
+#define MIP_TEXTURE_HH
+
+#include "binary_scene.hh"
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/*
+  layout of a mipmapped texture, stored little endian like the binary
+  scene. the header is followed by level_count mip_level entries, the
+  first of them the full size image and every next one half the size of
+  the one before it down to a single texel. the texels of every level are
+  8 bit sRGB RGBA and start on a page of their own, so a renderer can map
+  the file and sample it in place.
+
+  untiled levels are stored row by row. tiled levels are cut into
+  tile_size by tile_size tiles, stored row by row with the texels inside
+  each tile row by row as well. tiles over the edge of a level repeat its
+  last row and column.
+*/
+constexpr char MIP_MAGIC[8] = { 'J', 'U', 'C', 'M', 'I', 'P', 0, 0 };
+constexpr std::uint32_t MIP_VERSION = 1;
+constexpr std::uint64_t MIP_ALIGNMENT = 4096;
+constexpr std::uint32_t MIP_TILE_SIZE = 32;
+constexpr std::uint32_t MIP_TEXEL_SIZE = 4;
+
+constexpr std::uint32_t MIP_FLAG_TILED = 1 << 0;
+
+struct mip_header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t flags;
+        std::uint64_t file_size;
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t level_count;
+        /* zero when the levels are not tiled */
+        std::uint32_t tile_size;
+};
+
+struct mip_level {
+        binary_section texels;
+        std::uint32_t width;
+        std::uint32_t height;
+};
+
+static_assert(sizeof(mip_header) == 40);
+static_assert(sizeof(mip_level) == 24);
+
+struct mip_image {
+        std::uint32_t width;
+        std::uint32_t height;
+        /* row by row, MIP_TEXEL_SIZE bytes per texel */
+        std::vector<std::uint8_t> texels;
+};
+
+/* every level of image, averaging each 2 by 2 block of texels in linear
+ * space into one. the last row or column of a level with an odd size is
+ * folded into the one before it */
+std::vector<mip_image> build_mip_chain(mip_image image);
+void write_mip_texture(std::ostream &stream,
+                       const std::vector<mip_image> &levels, bool tiled);
+
+#endif
@@ -0,0 +1,911 @@
+#include "native_import.hh"
+#include "mapped_file.hh"
+#include "postprocess.hh"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+/* bytes of an obj file parsed by a single task */
+constexpr std::size_t OBJ_CHUNK_SIZE = std::size_t(1) << 20;
+constexpr std::uint32_t NO_INDEX = std::uint32_t(-1);
+const std::string DEFAULT_MATERIAL_NAME = "DefaultMaterial";
+
+/* the scene is built in place, so it frees whatever was made when an
+ * importer throws */
+std::unique_ptr<aiScene> make_scene(std::size_t meshes,
+                                    std::size_t materials) {
+        auto scene = std::make_unique<aiScene>();
+        scene->mMeshes = new aiMesh *[meshes]();
+        scene->mNumMeshes = meshes;
+        scene->mMaterials = new aiMaterial *[materials]();
+        scene->mNumMaterials = materials;
+        scene->mRootNode = new aiNode();
+        scene->mRootNode->mName = aiString(std::string("root"));
+        scene->mRootNode->mMeshes = new unsigned int[meshes];
+        scene->mRootNode->mNumMeshes = meshes;
+        for (std::size_t idx = 0; idx < meshes; ++idx) {
+                scene->mMeshes[idx] = new aiMesh();
+                scene->mMeshes[idx]->mPrimitiveTypes
+                    = aiPrimitiveType_TRIANGLE;
+                scene->mRootNode->mMeshes[idx] = idx;
+        }
+        return scene;
+}
+
+aiMaterial *make_material(const std::string &name) {
+        aiMaterial *result = new aiMaterial();
+        const aiString value(name);
+        result->AddProperty(&value, AI_MATKEY_NAME);
+        return result;
+}
+
+void allocate_faces(aiMesh *mesh, std::size_t count) {
+        if (count > std::numeric_limits<unsigned int>::max() / 3)
+                throw std::runtime_error("mesh has too many faces");
+        mesh->mFaces = new aiFace[count];
+        mesh->mNumFaces = count;
+}
+
+/* the flipped triangles of a fan over the corners of a polygon, which is
+ * what assimp's triangulation and winding order flip leave of a convex
+ * polygon */
+template <typename Corner, typename Out>
+void triangulate(const std::vector<Corner> &corners, Out out) {
+        for (std::size_t idx = 1; idx + 1 < corners.size(); ++idx)
+                out(corners[idx + 1], corners[idx], corners[0]);
+}
+
+bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+std::string_view next_token(std::string_view &line) {
+        std::size_t begin = 0;
+        while (begin < line.size() && is_space(line[begin]))
+                ++begin;
+        std::size_t end = begin;
+        while (end < line.size() && !is_space(line[end]))
+                ++end;
+        const std::string_view token = line.substr(begin, end - begin);
+        line.remove_prefix(end);
+        return token;
+}
+
+std::string_view trim(std::string_view text) {
+        while (!text.empty() && is_space(text.front()))
+                text.remove_prefix(1);
+        while (!text.empty() && is_space(text.back()))
+                text.remove_suffix(1);
+        return text;
+}
+
+/* the line at pos without its newline, pos moves on to the next one.
+ * memchr is vectorized by the c library, which is where most of the
+ * scanning happens */
+std::string_view next_line(std::string_view text, std::size_t &pos) {
+        const void *const newline
+            = std::memchr(text.data() + pos, '\n', text.size() - pos);
+        const std::size_t end
+            = newline == nullptr
+                  ? text.size()
+                  : static_cast<const char *>(newline) - text.data();
+        const std::string_view line = text.substr(pos, end - pos);
+        pos = std::min(text.size(), end + 1);
+        return line;
+}
+
+/* from_chars parses floats with the fast path of the Eisel-Lemire
+ * algorithm and never looks at the locale */
+template <typename T> T parse_number(std::string_view token) {
+        if (!token.empty() && token.front() == '+')
+                token.remove_prefix(1);
+        T result{};
+        const char *const end = token.data() + token.size();
+        const auto [last, error] = std::from_chars(token.data(), end, result);
+        if (error != std::errc() || last != end || token.empty())
+                throw std::runtime_error("invalid number \""
+                                         + std::string(token) + "\"");
+        return result;
+}
+
+/* up to three numbers, missing ones are zero */
+aiVector3D parse_vector(std::string_view rest, std::size_t required) {
+        aiVector3D result;
+        for (std::size_t idx = 0; idx < 3; ++idx) {
+                const std::string_view token = next_token(rest);
+                if (token.empty()) {
+                        if (idx < required)
+                                throw std::runtime_error(
+                                    "missing coordinate");
+                        break;
+                }
+                result[idx] = parse_number<ai_real>(token);
+        }
+        return result;
+}
+
+struct obj_corner {
+        std::uint32_t position;
+        std::uint32_t uv;
+        std::uint32_t normal;
+};
+
+struct obj_counts {
+        std::size_t positions = 0;
+        std::size_t uvs = 0;
+        std::size_t normals = 0;
+        std::size_t triangles = 0;
+};
+
+struct obj_chunk {
+        std::size_t begin, end;
+        obj_counts counts;
+        /* of the chunks before this one */
+        obj_counts offsets;
+        /* every usemtl with the number of triangles before it */
+        std::vector<std::pair<std::size_t, std::string>> materials;
+        std::vector<std::string> libraries;
+        /* number of segments that started before this chunk */
+        std::size_t segment = 0;
+        /* VERTEX_UV and VERTEX_NORMAL for every mesh the chunk has corners
+         * with uvs or normals in */
+        std::vector<unsigned char> attributes;
+};
+
+/* a run of faces with the same material */
+struct obj_segment {
+        std::string material;
+        std::size_t first;
+        std::size_t mesh;
+        /* of its first triangle in the mesh */
+        std::size_t offset;
+};
+
+constexpr unsigned char OBJ_UV = 1 << 0;
+constexpr unsigned char OBJ_NORMAL = 1 << 1;
+
+std::size_t count_corners(std::string_view rest) {
+        std::size_t result = 0;
+        while (!next_token(rest).empty())
+                ++result;
+        return result;
+}
+
+void count_chunk(std::string_view text, obj_chunk &chunk) {
+        std::size_t pos = chunk.begin;
+        const std::string_view part = text.substr(0, chunk.end);
+        while (pos < chunk.end) {
+                std::string_view rest = next_line(part, pos);
+                const std::string_view keyword = next_token(rest);
+                if (keyword == "v") {
+                        ++chunk.counts.positions;
+                } else if (keyword == "vt") {
+                        ++chunk.counts.uvs;
+                } else if (keyword == "vn") {
+                        ++chunk.counts.normals;
+                } else if (keyword == "f") {
+                        const std::size_t corners = count_corners(rest);
+                        if (corners >= 3)
+                                chunk.counts.triangles += corners - 2;
+                } else if (keyword == "usemtl") {
+                        chunk.materials.emplace_back(chunk.counts.triangles,
+                                                     trim(rest));
+                } else if (keyword == "mtllib") {
+                        for (std::string_view lib = next_token(rest);
+                             !lib.empty(); lib = next_token(rest))
+                                chunk.libraries.emplace_back(lib);
+                }
+        }
+}
+
+/* the zero based index of a reference to one of count elements when
+ * before of them came before it */
+std::uint32_t resolve(std::string_view token, std::size_t before,
+                      std::size_t count) {
+        const long long value = parse_number<long long>(token);
+        const long long idx = value > 0 ? value - 1 : before + value;
+        if (value == 0 || idx < 0 || std::size_t(idx) >= count)
+                throw std::runtime_error("face refers to a missing vertex");
+        return idx;
+}
+
+struct obj_data {
+        std::vector<aiVector3D> positions;
+        std::vector<aiVector3D> uvs;
+        std::vector<aiVector3D> normals;
+        std::vector<obj_segment> segments;
+        /* three per triangle of every mesh */
+        std::vector<std::vector<obj_corner>> corners;
+};
+
+void parse_chunk(std::string_view text, obj_chunk &chunk, obj_data &data) {
+        std::size_t pos = chunk.begin;
+        const std::string_view part = text.substr(0, chunk.end);
+        obj_counts done;
+        std::size_t segment = chunk.segment - 1;
+        std::vector<obj_corner> polygon;
+        while (pos < chunk.end) {
+                std::string_view rest = next_line(part, pos);
+                const std::string_view keyword = next_token(rest);
+                if (keyword == "v") {
+                        data.positions[chunk.offsets.positions
+                                       + done.positions++]
+                            = parse_vector(rest, 3);
+                } else if (keyword == "vt") {
+                        data.uvs[chunk.offsets.uvs + done.uvs++]
+                            = parse_vector(rest, 1);
+                } else if (keyword == "vn") {
+                        data.normals[chunk.offsets.normals + done.normals++]
+                            = parse_vector(rest, 3);
+                } else if (keyword == "usemtl") {
+                        ++segment;
+                } else if (keyword == "f") {
+                        polygon.clear();
+                        for (std::string_view token = next_token(rest);
+                             !token.empty(); token = next_token(rest)) {
+                                obj_corner corner = { 0, NO_INDEX, NO_INDEX };
+                                const std::size_t first = token.find('/');
+                                corner.position = resolve(
+                                    token.substr(0, first),
+                                    chunk.offsets.positions + done.positions,
+                                    data.positions.size());
+                                if (first != std::string_view::npos) {
+                                        token.remove_prefix(first + 1);
+                                        const std::size_t second
+                                            = token.find('/');
+                                        const std::string_view uv
+                                            = token.substr(0, second);
+                                        if (!uv.empty())
+                                                corner.uv = resolve(
+                                                    uv,
+                                                    chunk.offsets.uvs
+                                                        + done.uvs,
+                                                    data.uvs.size());
+                                        if (second != std::string_view::npos)
+                                                corner.normal = resolve(
+                                                    token.substr(second + 1),
+                                                    chunk.offsets.normals
+                                                        + done.normals,
+                                                    data.normals.size());
+                                }
+                                polygon.push_back(corner);
+                        }
+                        if (polygon.size() < 3)
+                                continue;
+                        const obj_segment &seg = data.segments[segment];
+                        obj_corner *out
+                            = data.corners[seg.mesh].data()
+                              + (seg.offset + chunk.offsets.triangles
+                                 + done.triangles - seg.first)
+                                    * 3;
+                        done.triangles += polygon.size() - 2;
+                        unsigned char &attributes
+                            = chunk.attributes[seg.mesh];
+                        triangulate(polygon, [&out](const obj_corner &a,
+                                                    const obj_corner &b,
+                                                    const obj_corner &c) {
+                                *out++ = a;
+                                *out++ = b;
+                                *out++ = c;
+                        });
+                        for (const obj_corner &corner : polygon) {
+                                attributes |= (corner.uv != NO_INDEX
+                                                   ? OBJ_UV
+                                                   : 0)
+                                              | (corner.normal != NO_INDEX
+                                                     ? OBJ_NORMAL
+                                                     : 0);
+                        }
+                }
+        }
+}
+
+/* a texture path is the last word of its line, after any options */
+std::string_view last_token(std::string_view rest) {
+        std::string_view result;
+        for (std::string_view token = next_token(rest); !token.empty();
+             token = next_token(rest))
+                result = token;
+        return result;
+}
+
+void read_materials(const std::filesystem::path &path,
+                    std::vector<aiMaterial *> &materials,
+                    std::unordered_map<std::string, std::size_t> &indices) {
+        std::ifstream file(path);
+        if (!file) {
+                std::cerr << "warning: " << path.string()
+                          << ": could not open material library"
+                          << std::endl;
+                return;
+        }
+        const std::unordered_map<std::string_view, aiTextureType> maps
+            = { { "map_Kd", aiTextureType_DIFFUSE },
+                { "map_Ks", aiTextureType_SPECULAR },
+                { "map_Ka", aiTextureType_AMBIENT },
+                { "map_Ke", aiTextureType_EMISSIVE },
+                { "map_d", aiTextureType_OPACITY },
+                { "map_Ns", aiTextureType_SHININESS },
+                { "map_bump", aiTextureType_HEIGHT },
+                { "bump", aiTextureType_HEIGHT },
+                { "norm", aiTextureType_NORMALS } };
+        aiMaterial *material = nullptr;
+        std::string line;
+        while (std::getline(file, line)) {
+                std::string_view rest = line;
+                const std::string_view keyword = next_token(rest);
+                if (keyword == "newmtl") {
+                        const std::string name(trim(rest));
+                        material = make_material(name);
+                        indices[name] = materials.size();
+                        materials.push_back(material);
+                        continue;
+                }
+                if (material == nullptr)
+                        continue;
+                if (keyword == "Kd" || keyword == "Ks" || keyword == "Ke") {
+                        const aiVector3D value = parse_vector(rest, 1);
+                        /* a single value is a grey */
+                        const aiColor3D color
+                            = count_corners(rest) == 1
+                                  ? aiColor3D(value.x, value.x, value.x)
+                                  : aiColor3D(value.x, value.y, value.z);
+                        if (keyword == "Kd")
+                                material->AddProperty(
+                                    &color, 1, AI_MATKEY_COLOR_DIFFUSE);
+                        else if (keyword == "Ks")
+                                material->AddProperty(
+                                    &color, 1, AI_MATKEY_COLOR_SPECULAR);
+                        else
+                                material->AddProperty(
+                                    &color, 1, AI_MATKEY_COLOR_EMISSIVE);
+                } else if (keyword == "Ns") {
+                        const ai_real value
+                            = parse_number<ai_real>(next_token(rest));
+                        material->AddProperty(&value, 1, AI_MATKEY_SHININESS);
+                } else if (keyword == "d" || keyword == "Tr") {
+                        ai_real value
+                            = parse_number<ai_real>(next_token(rest));
+                        if (keyword == "Tr")
+                                value = 1 - value;
+                        material->AddProperty(&value, 1, AI_MATKEY_OPACITY);
+                } else if (const auto map = maps.find(keyword);
+                           map != maps.end()) {
+                        const std::string file_name(last_token(rest));
+                        const aiString value(file_name);
+                        material->AddProperty(
+                            &value, AI_MATKEY_TEXTURE(map->second, 0));
+                }
+        }
+}
+
+std::unique_ptr<aiScene> import_obj(const mapped_file &file,
+                                    scheduler &pool, std::size_t grain) {
+        const std::string_view text = file.contents();
+        std::vector<obj_chunk> chunks;
+        for (std::size_t pos = 0; pos < text.size();) {
+                std::size_t end = std::min(text.size(), pos + OBJ_CHUNK_SIZE);
+                next_line(text, end);
+                chunks.push_back({ pos, end, {}, {}, {}, {}, 0, {} });
+                pos = end;
+        }
+        pool.parallel_for(chunks.size(), [&text, &chunks](std::size_t idx) {
+                count_chunk(text, chunks[idx]);
+        });
+
+        obj_data data;
+        obj_counts total;
+        std::vector<std::string> libraries;
+        data.segments.push_back({ "", 0, 0, 0 });
+        for (obj_chunk &chunk : chunks) {
+                chunk.offsets = total;
+                chunk.segment = data.segments.size();
+                total.positions += chunk.counts.positions;
+                total.uvs += chunk.counts.uvs;
+                total.normals += chunk.counts.normals;
+                total.triangles += chunk.counts.triangles;
+                for (const auto &[first, name] : chunk.materials)
+                        data.segments.push_back(
+                            { name, chunk.offsets.triangles + first, 0, 0 });
+                libraries.insert(libraries.end(), chunk.libraries.begin(),
+                                 chunk.libraries.end());
+        }
+        if (total.positions > NO_INDEX || total.uvs > NO_INDEX
+            || total.normals > NO_INDEX)
+                throw std::runtime_error("too many vertices");
+
+        std::vector<aiMaterial *> materials;
+        std::unordered_map<std::string, std::size_t> material_indices;
+        try {
+                for (const std::string &library : libraries)
+                        read_materials(file.path.parent_path() / library,
+                                       materials, material_indices);
+        } catch (...) {
+                for (aiMaterial *material : materials)
+                        delete material;
+                throw;
+        }
+
+        /* files with nothing but points or lines are left to assimp */
+        if (total.triangles == 0)
+                return nullptr;
+
+        /* every material with faces gets a mesh, in the order the
+         * materials are first used */
+        std::vector<std::string> mesh_materials;
+        std::vector<std::size_t> mesh_triangles;
+        std::unordered_map<std::string, std::size_t> mesh_indices;
+        for (std::size_t idx = 0; idx < data.segments.size(); ++idx) {
+                obj_segment &seg = data.segments[idx];
+                const std::size_t next = idx + 1 < data.segments.size()
+                                             ? data.segments[idx + 1].first
+                                             : total.triangles;
+                if (next == seg.first)
+                        continue;
+                if (!material_indices.contains(seg.material))
+                        seg.material = DEFAULT_MATERIAL_NAME;
+                const auto [it, inserted] = mesh_indices.emplace(
+                    seg.material, mesh_materials.size());
+                if (inserted) {
+                        mesh_materials.push_back(seg.material);
+                        mesh_triangles.push_back(0);
+                }
+                seg.mesh = it->second;
+                seg.offset = mesh_triangles[seg.mesh];
+                mesh_triangles[seg.mesh] += next - seg.first;
+        }
+        if (mesh_indices.contains(DEFAULT_MATERIAL_NAME)
+            && !material_indices.contains(DEFAULT_MATERIAL_NAME)) {
+                material_indices[DEFAULT_MATERIAL_NAME] = materials.size();
+                materials.push_back(make_material(DEFAULT_MATERIAL_NAME));
+        }
+
+        std::unique_ptr<aiScene> scene;
+        try {
+                scene = make_scene(mesh_materials.size(),
+                                   std::max<std::size_t>(1, materials.size()));
+        } catch (...) {
+                for (aiMaterial *material : materials)
+                        delete material;
+                throw;
+        }
+        std::copy(materials.begin(), materials.end(), scene->mMaterials);
+        if (materials.empty())
+                scene->mMaterials[0] = make_material(DEFAULT_MATERIAL_NAME);
+
+        data.positions.resize(total.positions);
+        data.uvs.resize(total.uvs);
+        data.normals.resize(total.normals);
+        data.corners.resize(mesh_materials.size());
+        for (std::size_t mesh = 0; mesh < mesh_materials.size(); ++mesh)
+                data.corners[mesh].resize(mesh_triangles[mesh] * 3);
+        pool.parallel_for(chunks.size(), [&](std::size_t idx) {
+                chunks[idx].attributes.resize(mesh_materials.size());
+                parse_chunk(text, chunks[idx], data);
+        });
+
+        /* every corner becomes a vertex of its own, joining them below
+         * leaves one of each, as assimp's obj importer does */
+        std::vector<unsigned char> attributes(mesh_materials.size());
+        for (const obj_chunk &chunk : chunks) {
+                for (std::size_t mesh = 0; mesh < attributes.size(); ++mesh)
+                        attributes[mesh] |= chunk.attributes[mesh];
+        }
+        for (std::size_t idx = 0; idx < mesh_materials.size(); ++idx) {
+                aiMesh *mesh = scene->mMeshes[idx];
+                const std::size_t vertices = mesh_triangles[idx] * 3;
+                mesh->mName = aiString(mesh_materials[idx]);
+                mesh->mMaterialIndex
+                    = material_indices.at(mesh_materials[idx]);
+                allocate_faces(mesh, mesh_triangles[idx]);
+                mesh->mVertices = new aiVector3D[vertices];
+                mesh->mNumVertices = vertices;
+                if (attributes[idx] & OBJ_UV) {
+                        mesh->mTextureCoords[0] = new aiVector3D[vertices];
+                        mesh->mNumUVComponents[0] = 2;
+                }
+                if (attributes[idx] & OBJ_NORMAL)
+                        mesh->mNormals = new aiVector3D[vertices];
+        }
+        std::vector<std::pair<std::size_t, std::size_t>> ranges;
+        grain = std::max<std::size_t>(1, grain);
+        for (std::size_t mesh = 0; mesh < mesh_triangles.size(); ++mesh) {
+                for (std::size_t begin = 0; begin < mesh_triangles[mesh];
+                     begin += grain)
+                        ranges.emplace_back(mesh, begin);
+        }
+        pool.parallel_for(ranges.size(), [&](std::size_t idx) {
+                const auto [mesh_idx, begin] = ranges[idx];
+                aiMesh *mesh = scene->mMeshes[mesh_idx];
+                const std::size_t end
+                    = std::min<std::size_t>(mesh->mNumFaces, begin + grain);
+                const std::vector<obj_corner> &corners
+                    = data.corners[mesh_idx];
+                for (std::size_t face = begin; face < end; ++face) {
+                        mesh->mFaces[face].mIndices = new unsigned int[3];
+                        mesh->mFaces[face].mNumIndices = 3;
+                        for (std::size_t corner = 0; corner < 3; ++corner) {
+                                const std::size_t vert = face * 3 + corner;
+                                const obj_corner &src = corners[vert];
+                                mesh->mFaces[face].mIndices[corner] = vert;
+                                mesh->mVertices[vert]
+                                    = data.positions[src.position];
+                                if (mesh->mTextureCoords[0] != nullptr)
+                                        mesh->mTextureCoords[0][vert]
+                                            = src.uv == NO_INDEX
+                                                  ? aiVector3D()
+                                                  : data.uvs[src.uv];
+                                if (mesh->mNormals != nullptr)
+                                        mesh->mNormals[vert]
+                                            = src.normal == NO_INDEX
+                                                  ? aiVector3D()
+                                                  : data.normals[src.normal];
+                        }
+                }
+        });
+        data = obj_data();
+        join_vertices(pool,
+                      std::span<aiMesh *const>(scene->mMeshes,
+                                               scene->mNumMeshes),
+                      grain);
+        return scene;
+}
+
+enum class ply_type { int8, uint8, int16, uint16, int32, uint32, f32, f64 };
+
+std::optional<ply_type> parse_ply_type(std::string_view name) {
+        const std::pair<std::string_view, ply_type> names[] = {
+                { "char", ply_type::int8 },     { "int8", ply_type::int8 },
+                { "uchar", ply_type::uint8 },   { "uint8", ply_type::uint8 },
+                { "short", ply_type::int16 },   { "int16", ply_type::int16 },
+                { "ushort", ply_type::uint16 }, { "uint16", ply_type::uint16 },
+                { "int", ply_type::int32 },     { "int32", ply_type::int32 },
+                { "uint", ply_type::uint32 },   { "uint32", ply_type::uint32 },
+                { "float", ply_type::f32 },     { "float32", ply_type::f32 },
+                { "double", ply_type::f64 },    { "float64", ply_type::f64 },
+        };
+        for (const auto &[type_name, type] : names) {
+                if (type_name == name)
+                        return type;
+        }
+        return std::nullopt;
+}
+
+std::size_t ply_size(ply_type type) {
+        switch (type) {
+        case ply_type::int8:
+        case ply_type::uint8:
+                return 1;
+        case ply_type::int16:
+        case ply_type::uint16:
+                return 2;
+        case ply_type::int32:
+        case ply_type::uint32:
+        case ply_type::f32:
+                return 4;
+        default:
+                return 8;
+        }
+}
+
+template <typename T> T load(const char *data) {
+        T result;
+        std::memcpy(&result, data, sizeof(T));
+        return result;
+}
+
+/* the value at data, which is little endian like the host */
+double read_ply(const char *data, ply_type type) {
+        switch (type) {
+        case ply_type::int8:
+                return load<std::int8_t>(data);
+        case ply_type::uint8:
+                return load<std::uint8_t>(data);
+        case ply_type::int16:
+                return load<std::int16_t>(data);
+        case ply_type::uint16:
+                return load<std::uint16_t>(data);
+        case ply_type::int32:
+                return load<std::int32_t>(data);
+        case ply_type::uint32:
+                return load<std::uint32_t>(data);
+        case ply_type::f32:
+                return load<float>(data);
+        default:
+                return load<double>(data);
+        }
+}
+
+struct ply_property {
+        std::string name;
+        ply_type type;
+        /* the type of the length of a list property */
+        std::optional<ply_type> list;
+        /* in the record, for properties before the first list */
+        std::size_t offset;
+};
+
+struct ply_element {
+        std::string name;
+        std::size_t count;
+        std::vector<ply_property> properties;
+        /* of a record when it has no lists */
+        std::size_t size = 0;
+        bool lists = false;
+
+        const ply_property *find(std::string_view property) const {
+                for (const ply_property &prop : properties) {
+                        if (prop.name == property)
+                                return &prop;
+                }
+                return nullptr;
+        }
+};
+
+/* the size of the record of element at data */
+std::size_t ply_record(const ply_element &element, const char *data,
+                       const char *end) {
+        if (!element.lists)
+                return element.size;
+        std::size_t result = 0;
+        for (const ply_property &prop : element.properties) {
+                std::size_t size = ply_size(prop.type);
+                if (prop.list) {
+                        if (data + result + ply_size(*prop.list) > end)
+                                throw std::runtime_error("truncated file");
+                        const double length
+                            = read_ply(data + result, *prop.list);
+                        if (length < 0)
+                                throw std::runtime_error(
+                                    "negative list length");
+                        size = ply_size(*prop.list)
+                               + std::size_t(length) * size;
+                }
+                result += size;
+        }
+        if (data + result > end)
+                throw std::runtime_error("truncated file");
+        return result;
+}
+
+/* the first of the names that element has */
+const ply_property *
+find_any(const ply_element &element,
+         std::initializer_list<std::string_view> names) {
+        for (std::string_view name : names) {
+                if (const ply_property *prop = element.find(name))
+                        return prop;
+        }
+        return nullptr;
+}
+
+std::unique_ptr<aiScene> import_ply(const mapped_file &file,
+                                    scheduler &pool, std::size_t grain) {
+        const std::string_view text = file.contents();
+        std::size_t pos = 0;
+        if (trim(next_line(text, pos)) != "ply")
+                return nullptr;
+        std::vector<ply_element> elements;
+        bool binary = false;
+        while (true) {
+                if (pos >= text.size())
+                        throw std::runtime_error("truncated header");
+                std::string_view rest = next_line(text, pos);
+                const std::string_view keyword = next_token(rest);
+                if (keyword == "end_header")
+                        break;
+                if (keyword == "format") {
+                        binary = next_token(rest) == "binary_little_endian";
+                } else if (keyword == "element") {
+                        const std::string_view name = next_token(rest);
+                        elements.push_back(
+                            { std::string(name),
+                              parse_number<std::size_t>(next_token(rest)),
+                              {} });
+                } else if (keyword == "property") {
+                        if (elements.empty())
+                                return nullptr;
+                        ply_element &element = elements.back();
+                        std::string_view type_name = next_token(rest);
+                        std::optional<ply_type> list;
+                        if (type_name == "list") {
+                                list = parse_ply_type(next_token(rest));
+                                if (!list)
+                                        return nullptr;
+                                type_name = next_token(rest);
+                        }
+                        const auto type = parse_ply_type(type_name);
+                        if (!type)
+                                return nullptr;
+                        element.properties.push_back(
+                            { std::string(next_token(rest)), *type, list,
+                              element.size });
+                        element.lists |= list.has_value();
+                        element.size += ply_size(*type);
+                }
+        }
+        /* ascii and big endian files are left to assimp */
+        if (!binary)
+                return nullptr;
+
+        const char *data = text.data() + pos;
+        const char *const end = text.data() + text.size();
+        const ply_element *vertices = nullptr;
+        const ply_element *faces = nullptr;
+        const char *vertex_data = nullptr;
+        const char *face_data = nullptr;
+        for (const ply_element &element : elements) {
+                if (element.name == "vertex") {
+                        if (element.lists)
+                                return nullptr;
+                        vertices = &element;
+                        vertex_data = data;
+                } else if (element.name == "face") {
+                        faces = &element;
+                        face_data = data;
+                }
+                if (!element.lists) {
+                        if (element.size * element.count
+                            > std::size_t(end - data))
+                                throw std::runtime_error("truncated file");
+                        data += element.size * element.count;
+                        continue;
+                }
+                for (std::size_t idx = 0; idx < element.count; ++idx)
+                        data += ply_record(element, data, end);
+        }
+        /* point clouds are left to assimp */
+        if (vertices == nullptr || faces == nullptr)
+                return nullptr;
+        const ply_property *const x = vertices->find("x");
+        const ply_property *const y = vertices->find("y");
+        const ply_property *const z = vertices->find("z");
+        if (x == nullptr || y == nullptr || z == nullptr)
+                return nullptr;
+        if (vertices->count > std::numeric_limits<unsigned int>::max())
+                throw std::runtime_error("too many vertices");
+        const ply_property *const nx = vertices->find("nx");
+        const ply_property *const ny = vertices->find("ny");
+        const ply_property *const nz = vertices->find("nz");
+        const bool normals = nx != nullptr && ny != nullptr && nz != nullptr;
+        const ply_property *const u
+            = find_any(*vertices, { "u", "s", "texture_u", "texture_s" });
+        const ply_property *const v
+            = find_any(*vertices, { "v", "t", "texture_v", "texture_t" });
+        const bool uvs = u != nullptr && v != nullptr;
+
+        const ply_property *const indices
+            = find_any(*faces, { "vertex_indices", "vertex_index" });
+        /* faces with more than one list, such as per corner uvs, are left
+         * to assimp */
+        const std::size_t lists = std::count_if(
+            faces->properties.begin(), faces->properties.end(),
+            [](const ply_property &prop) { return prop.list.has_value(); });
+        if (indices == nullptr || !indices->list || lists != 1)
+                return nullptr;
+
+        /* faces have a size of their own, so where every range of them
+         * starts is found first */
+        grain = std::max<std::size_t>(1, grain);
+        std::vector<std::pair<const char *, std::size_t>> face_ranges;
+        std::size_t triangles = 0;
+        const std::size_t face_count = faces->count;
+        const char *record = face_data;
+        std::size_t indices_offset = 0;
+        for (const ply_property &prop : faces->properties) {
+                if (&prop == indices)
+                        break;
+                indices_offset += ply_size(prop.type);
+        }
+        for (std::size_t idx = 0; idx < face_count; ++idx) {
+                if (idx % grain == 0)
+                        face_ranges.emplace_back(record, triangles);
+                const std::size_t corners = read_ply(
+                    record + indices_offset, *indices->list);
+                if (corners >= 3)
+                        triangles += corners - 2;
+                record += ply_record(*faces, record, end);
+        }
+
+        std::unique_ptr<aiScene> scene = make_scene(1, 1);
+        scene->mMaterials[0] = make_material(DEFAULT_MATERIAL_NAME);
+        aiMesh *const mesh = scene->mMeshes[0];
+        mesh->mName = aiString(file.path.stem().string());
+        mesh->mVertices = new aiVector3D[vertices->count];
+        mesh->mNumVertices = vertices->count;
+        if (normals)
+                mesh->mNormals = new aiVector3D[vertices->count];
+        if (uvs) {
+                mesh->mTextureCoords[0] = new aiVector3D[vertices->count];
+                mesh->mNumUVComponents[0] = 2;
+        }
+        allocate_faces(mesh, triangles);
+
+        const std::size_t vertex_ranges
+            = (vertices->count + grain - 1) / grain;
+        pool.parallel_for(vertex_ranges, [&](std::size_t range) {
+                const std::size_t first = range * grain;
+                const std::size_t last
+                    = std::min(vertices->count, first + grain);
+                const auto read = [vertices](const char *data,
+                                             const ply_property *prop) {
+                        return ai_real(read_ply(data + prop->offset,
+                                                prop->type));
+                };
+                for (std::size_t idx = first; idx < last; ++idx) {
+                        const char *const src
+                            = vertex_data + idx * vertices->size;
+                        mesh->mVertices[idx] = aiVector3D(
+                            read(src, x), read(src, y), read(src, z));
+                        if (normals)
+                                mesh->mNormals[idx]
+                                    = aiVector3D(read(src, nx), read(src, ny),
+                                                 read(src, nz));
+                        if (uvs)
+                                mesh->mTextureCoords[0][idx] = aiVector3D(
+                                    read(src, u), read(src, v), 0);
+                }
+        });
+        pool.parallel_for(face_ranges.size(), [&](std::size_t range) {
+                const char *src = face_ranges[range].first;
+                aiFace *out = mesh->mFaces + face_ranges[range].second;
+                const std::size_t first = range * grain;
+                const std::size_t last = std::min(face_count, first + grain);
+                const std::size_t index_size = ply_size(indices->type);
+                std::vector<unsigned int> polygon;
+                for (std::size_t idx = first; idx < last; ++idx) {
+                        const char *corner = src + indices_offset;
+                        const std::size_t corners
+                            = read_ply(corner, *indices->list);
+                        corner += ply_size(*indices->list);
+                        polygon.clear();
+                        for (std::size_t k = 0; k < corners; ++k) {
+                                const double value
+                                    = read_ply(corner, indices->type);
+                                if (value < 0 || value >= vertices->count)
+                                        throw std::runtime_error(
+                                            "face refers to a missing vertex");
+                                polygon.push_back(value);
+                                corner += index_size;
+                        }
+                        triangulate(polygon, [&out](unsigned int a,
+                                                    unsigned int b,
+                                                    unsigned int c) {
+                                out->mIndices = new unsigned int[3]{ a, b,
+                                                                     c };
+                                out->mNumIndices = 3;
+                                ++out;
+                        });
+                        src += ply_record(*faces, src, end);
+                }
+        });
+        return scene;
+}
+}
+
+std::unique_ptr<aiScene> import_native(const std::filesystem::path &path,
+                                       scheduler &pool, std::size_t grain) {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        if (extension != ".obj" && extension != ".ply")
+                return nullptr;
+        const mapped_file file(path);
+        try {
+                if (extension == ".obj")
+                        return import_obj(file, pool, grain);
+                return import_ply(file, pool, grain);
+        } catch (const std::exception &ex) {
+                throw std::runtime_error(path.string() + ": " + ex.what());
+        }
+}
@@ -0,0 +1,31 @@
+#ifndef NATIVE_IMPORT_HH
+#define NATIVE_IMPORT_HH
+
+#include "scheduler.hh"
+#include <assimp/scene.h>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+
+/*
+  importers for wavefront obj and binary little endian ply files that
+  parse the mapped file on the pool instead of going through assimp. the
+  scene they build is what assimp gives juc after its post processing:
+  triangles only, with their winding order flipped, every mesh on the
+  root node and, for obj, identical vertices joined. smooth normals are
+  left to generate_normals.
+
+  obj files are cut into chunks at line boundaries, which are counted
+  first so that every chunk knows where its vertices and faces go when it
+  is parsed. faces are split into one mesh per material. ply vertices are
+  read in ranges of grain, the faces have a variable size and are found
+  in one pass before they are read in ranges as well.
+*/
+
+/* null when path is not an obj or ply file or uses something these
+ * importers do not handle, the caller falls back on assimp then. may not
+ * be called from a task */
+std::unique_ptr<aiScene> import_native(const std::filesystem::path &path,
+                                       scheduler &pool, std::size_t grain);
+
+#endif
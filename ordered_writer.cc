@@ -0,0 +1,103 @@
+#include "ordered_writer.hh"
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+ordered_writer::ordered_writer(std::ostream &out, std::size_t max_buffered)
+    : _out(&out), _file(nullptr), _max_buffered(max_buffered) {}
+
+ordered_writer::ordered_writer(const output_file &file,
+                               std::size_t max_buffered)
+    : _out(nullptr), _file(&file), _max_buffered(max_buffered) {}
+
+std::size_t ordered_writer::reserve() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _reserved++;
+}
+
+void ordered_writer::submit(std::size_t slot, text_buffer &&chunk) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        /* the next chunk is always accepted, otherwise the worker that
+         * would free up the buffer could be the one waiting for room */
+        _cond.wait(lock, [this, slot, &chunk]() {
+                return _error || slot == _next || _buffered == 0
+                       || _buffered + chunk.size() <= _max_buffered;
+        });
+        if (_error)
+                return;
+        _buffered += chunk.size();
+        _pending.emplace(slot, std::move(chunk));
+        if (_file != nullptr)
+                place(lock);
+        else if (_writers == 0)
+                flush(lock);
+}
+
+void ordered_writer::abort(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_error)
+                _error = error;
+        _cond.notify_all();
+}
+
+void ordered_writer::finish() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond.wait(lock, [this]() {
+                return _error || (_next == _reserved && _writers == 0);
+        });
+        if (_error)
+                std::rethrow_exception(_error);
+        if (_out == nullptr)
+                return;
+        _out->flush();
+        if (!*_out)
+                throw std::runtime_error("could not write output");
+}
+
+void ordered_writer::flush(std::unique_lock<std::mutex> &lock) {
+        _writers += 1;
+        while (!_error && !_pending.empty()
+               && _pending.begin()->first == _next) {
+                auto node = _pending.extract(_pending.begin());
+                lock.unlock();
+                _out->write(node.mapped().data(), node.mapped().size());
+                lock.lock();
+                _buffered -= node.mapped().size();
+                _next += 1;
+                _cond.notify_all();
+        }
+        _writers -= 1;
+        _cond.notify_all();
+}
+
+void ordered_writer::place(std::unique_lock<std::mutex> &lock) {
+        std::vector<std::pair<std::uint64_t, text_buffer>> placed;
+        while (!_pending.empty() && _pending.begin()->first == _next) {
+                auto node = _pending.extract(_pending.begin());
+                placed.emplace_back(_offset, std::move(node.mapped()));
+                _offset += placed.back().second.size();
+                _next += 1;
+        }
+        if (placed.empty())
+                return;
+        /* the slots are taken, later chunks can be placed while these are
+         * being written */
+        _writers += 1;
+        _cond.notify_all();
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+                for (const auto &[offset, chunk] : placed) {
+                        _file->write(chunk.data(), chunk.size(), offset);
+                }
+        } catch (...) {
+                error = std::current_exception();
+        }
+        lock.lock();
+        for (const auto &placed_chunk : placed)
+                _buffered -= placed_chunk.second.size();
+        if (error && !_error)
+                _error = error;
+        _writers -= 1;
+        _cond.notify_all();
+}
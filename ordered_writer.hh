@@ -0,0 +1,61 @@
+#ifndef ORDERED_WRITER_HH
+#define ORDERED_WRITER_HH
+
+#include "format.hh"
+#include "output_file.hh"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <ostream>
+
+/*
+  reorder buffer between the mesh workers and the output. a slot is
+  reserved for every chunk in the order it has to appear in the output, and
+  a chunk is placed as soon as it and every chunk before it have been
+  submitted. workers that finish too far ahead block in submit while more
+  than max_buffered bytes are waiting to be written.
+
+  a stream is written by one thread at a time in slot order. an output
+  file only needs the sizes of the chunks before a chunk to know where it
+  goes, so placed chunks are written at their offsets by whichever
+  thread placed them, with any number of threads writing at once.
+*/
+class ordered_writer {
+        std::ostream *const _out;
+        const output_file *const _file;
+        const std::size_t _max_buffered;
+        std::mutex _mutex;
+        std::condition_variable _cond;
+        std::map<std::size_t, text_buffer> _pending;
+        std::size_t _reserved = 0;
+        std::size_t _next = 0;
+        std::size_t _buffered = 0;
+        /* offset in the file of the chunk in slot _next */
+        std::uint64_t _offset = 0;
+        /* threads writing placed chunks */
+        std::size_t _writers = 0;
+        std::exception_ptr _error;
+
+      public:
+        ordered_writer() = delete;
+        ordered_writer(std::ostream &out, std::size_t max_buffered);
+        ordered_writer(const output_file &file, std::size_t max_buffered);
+        ordered_writer(const ordered_writer &other) = delete;
+        ~ordered_writer() = default;
+
+        ordered_writer &operator=(const ordered_writer &other) = delete;
+
+        std::size_t reserve();
+        void submit(std::size_t slot, text_buffer &&chunk);
+        void abort(std::exception_ptr error);
+        void finish();
+
+      private:
+        void flush(std::unique_lock<std::mutex> &lock);
+        void place(std::unique_lock<std::mutex> &lock);
+};
+
+#endif
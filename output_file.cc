@@ -0,0 +1,40 @@
+#include "output_file.hh"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+output_file::output_file(const std::filesystem::path &path)
+    : _fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)),
+      path(path) {
+        if (_fd < 0)
+                throw std::runtime_error(path.string() + ": "
+                                         + std::strerror(errno));
+}
+
+output_file::~output_file() { close(_fd); }
+
+void output_file::write(const char *data, std::size_t size,
+                        std::uint64_t offset) const {
+        while (size != 0) {
+                const ssize_t count = pwrite(_fd, data, size, offset);
+                if (count < 0 && errno == EINTR)
+                        continue;
+                if (count <= 0)
+                        throw std::runtime_error(path.string()
+                                                 + ": could not write output");
+                data += count;
+                size -= count;
+                offset += count;
+        }
+}
+
+bool output_file::supports(const std::filesystem::path &path) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+                return errno == ENOENT;
+        return S_ISREG(st.st_mode);
+}
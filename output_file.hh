@@ -0,0 +1,34 @@
+#ifndef OUTPUT_FILE_HH
+#define OUTPUT_FILE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+/*
+  a regular file that is written at explicit offsets, so chunks whose
+  position in the output is known can be written by several threads at
+  once. the file is created, or truncated if it exists.
+*/
+class output_file {
+        int _fd;
+
+      public:
+        const std::filesystem::path path;
+
+        output_file() = delete;
+        explicit output_file(const std::filesystem::path &path);
+        output_file(const output_file &other) = delete;
+        ~output_file();
+
+        output_file &operator=(const output_file &other) = delete;
+
+        void write(const char *data, std::size_t size,
+                   std::uint64_t offset) const;
+
+        /* whether path can be written at offsets, which is not the case
+         * for pipes, terminals and other special files */
+        static bool supports(const std::filesystem::path &path);
+};
+
+#endif
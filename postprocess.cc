@@ -0,0 +1,258 @@
+#include "postprocess.hh"
+#include "mesh_edit.hh"
+#include "vertex_table.hh"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace {
+struct mesh_range {
+        std::size_t mesh;
+        std::size_t begin, end;
+};
+
+/* [0, count(mesh)) of every mesh cut into ranges of at most grain */
+template <typename Count>
+std::vector<mesh_range> split_meshes(std::size_t meshes, std::size_t grain,
+                                     Count count) {
+        grain = std::max<std::size_t>(1, grain);
+        std::vector<mesh_range> result;
+        for (std::size_t mesh = 0; mesh < meshes; ++mesh) {
+                const std::size_t size = count(mesh);
+                for (std::size_t begin = 0; begin < size; begin += grain)
+                        result.push_back(
+                            { mesh, begin, std::min(size, begin + grain) });
+        }
+        return result;
+}
+
+template <typename Fn>
+void for_ranges(scheduler &pool, const std::vector<mesh_range> &ranges,
+                const Fn &fn) {
+        pool.parallel_for(ranges.size(), [&ranges, &fn](std::size_t idx) {
+                fn(ranges[idx]);
+        });
+}
+
+/* the vertices of a mesh inserted into a table of their own, the owner of
+ * the entry of a vertex is the first vertex with the same key */
+struct vertex_groups {
+        std::unique_ptr<vertex_table> table;
+        std::vector<vertex_table::handle> handles;
+
+        inline std::size_t first(std::size_t idx) const {
+                return table->owner(handles[idx]);
+        }
+};
+
+template <typename Key>
+std::vector<vertex_groups>
+group_vertices(scheduler &pool, std::span<aiMesh *const> meshes,
+               const std::vector<mesh_range> &vertex_ranges, const Key &key) {
+        std::vector<vertex_groups> groups(meshes.size());
+        pool.parallel_for(meshes.size(), [&meshes, &groups](std::size_t mesh) {
+                const std::size_t count = meshes[mesh]->mNumVertices;
+                groups[mesh].table = std::make_unique<vertex_table>(count);
+                groups[mesh].handles.resize(count);
+        });
+        for_ranges(pool, vertex_ranges, [&meshes, &groups,
+                                         &key](const mesh_range &range) {
+                const aiMesh *mesh = meshes[range.mesh];
+                vertex_groups &group = groups[range.mesh];
+                for (std::size_t idx = range.begin; idx < range.end; ++idx)
+                        group.handles[idx] = group.table->insert(
+                            key(mesh, idx), 0, vertex_table::position(0, idx));
+        });
+        return groups;
+}
+}
+
+void generate_normals(scheduler &pool, std::span<aiMesh *const> all,
+                      std::size_t grain) {
+        std::vector<aiMesh *> meshes;
+        std::copy_if(all.begin(), all.end(), std::back_inserter(meshes),
+                     [](const aiMesh *mesh) {
+                             return mesh->mNormals == nullptr
+                                    && mesh->mNumFaces != 0;
+                     });
+        const auto vertex_count = [&meshes](std::size_t mesh) {
+                return std::size_t(meshes[mesh]->mNumVertices);
+        };
+        const auto face_count = [&meshes](std::size_t mesh) {
+                return std::size_t(meshes[mesh]->mNumFaces);
+        };
+        const std::vector<mesh_range> vertex_ranges
+            = split_meshes(meshes.size(), grain, vertex_count);
+        const std::vector<mesh_range> face_ranges
+            = split_meshes(meshes.size(), grain, face_count);
+        const std::vector<vertex_groups> groups = group_vertices(
+            pool, meshes, vertex_ranges,
+            [](const aiMesh *mesh, std::size_t idx) {
+                    vertex key{};
+                    key.point = converter::make_vertex(mesh, idx).point;
+                    return key;
+            });
+
+        /* the faces around every position, as a list at the first vertex
+         * there that is filled after counting how long each list is */
+        std::vector<std::vector<aiVector3D>> face_normals(meshes.size());
+        std::vector<std::unique_ptr<std::atomic<std::size_t>[]>> cursors(
+            meshes.size());
+        std::vector<std::vector<std::size_t>> offsets(meshes.size());
+        std::vector<std::vector<std::uint32_t>> around(meshes.size());
+        pool.parallel_for(meshes.size(), [&](std::size_t mesh) {
+                const std::size_t count = meshes[mesh]->mNumVertices;
+                meshes[mesh]->mNormals = new aiVector3D[count];
+                face_normals[mesh].resize(meshes[mesh]->mNumFaces);
+                cursors[mesh]
+                    = std::make_unique<std::atomic<std::size_t>[]>(count);
+                offsets[mesh].resize(count + 1);
+        });
+        for_ranges(pool, face_ranges, [&](const mesh_range &range) {
+                const aiMesh *mesh = meshes[range.mesh];
+                const aiVector3D *points = mesh->mVertices;
+                for (std::size_t idx = range.begin; idx < range.end; ++idx) {
+                        const aiFace &face = mesh->mFaces[idx];
+                        if (face.mNumIndices < 3)
+                                continue;
+                        const aiVector3D &a = points[face.mIndices[0]];
+                        const aiVector3D &b = points[face.mIndices[1]];
+                        const aiVector3D &c = points[face.mIndices[2]];
+                        /* as long as twice the area of the face */
+                        face_normals[range.mesh][idx] = (b - a) ^ (c - a);
+                        for (unsigned int corner = 0;
+                             corner < face.mNumIndices; ++corner)
+                                cursors[range.mesh]
+                                       [groups[range.mesh].first(
+                                            face.mIndices[corner])]
+                                           .fetch_add(
+                                               1, std::memory_order_relaxed);
+                }
+        });
+        pool.parallel_for(meshes.size(), [&](std::size_t mesh) {
+                std::vector<std::size_t> &offset = offsets[mesh];
+                for (std::size_t idx = 0; idx + 1 < offset.size(); ++idx) {
+                        offset[idx + 1] = offset[idx] + cursors[mesh][idx];
+                        cursors[mesh][idx] = offset[idx];
+                }
+                around[mesh].resize(offset.back());
+        });
+        for_ranges(pool, face_ranges, [&](const mesh_range &range) {
+                const aiMesh *mesh = meshes[range.mesh];
+                for (std::size_t idx = range.begin; idx < range.end; ++idx) {
+                        const aiFace &face = mesh->mFaces[idx];
+                        if (face.mNumIndices < 3)
+                                continue;
+                        for (unsigned int corner = 0;
+                             corner < face.mNumIndices; ++corner) {
+                                const std::size_t first
+                                    = groups[range.mesh].first(
+                                        face.mIndices[corner]);
+                                around[range.mesh][cursors[range.mesh][first]
+                                                       .fetch_add(1)]
+                                    = idx;
+                        }
+                }
+        });
+
+        /* the faces are summed in the same order however they were
+         * listed, so the normals come out the same on every run */
+        for_ranges(pool, vertex_ranges, [&](const mesh_range &range) {
+                aiMesh *mesh = meshes[range.mesh];
+                for (std::size_t idx = range.begin; idx < range.end; ++idx) {
+                        if (groups[range.mesh].first(idx) != idx)
+                                continue;
+                        const auto begin = around[range.mesh].begin()
+                                           + offsets[range.mesh][idx];
+                        const auto end = around[range.mesh].begin()
+                                         + offsets[range.mesh][idx + 1];
+                        std::sort(begin, end);
+                        aiVector3D sum;
+                        for (auto face = begin; face != end; ++face)
+                                sum += face_normals[range.mesh][*face];
+                        const float length = sum.Length();
+                        mesh->mNormals[idx]
+                            = length > 0.0f ? sum / length : aiVector3D();
+                }
+        });
+        for_ranges(pool, vertex_ranges, [&](const mesh_range &range) {
+                aiMesh *mesh = meshes[range.mesh];
+                for (std::size_t idx = range.begin; idx < range.end; ++idx) {
+                        const std::size_t first
+                            = groups[range.mesh].first(idx);
+                        if (first != idx)
+                                mesh->mNormals[idx] = mesh->mNormals[first];
+                }
+        });
+}
+
+void join_vertices(scheduler &pool, std::span<aiMesh *const> meshes,
+                   std::size_t grain) {
+        const std::vector<mesh_range> vertex_ranges = split_meshes(
+            meshes.size(), grain, [&meshes](std::size_t mesh) {
+                    return std::size_t(meshes[mesh]->mNumVertices);
+            });
+        const std::vector<vertex_groups> groups = group_vertices(
+            pool, meshes, vertex_ranges, converter::make_vertex);
+
+        /* the first vertex of every group is kept, the ones before a
+         * range are counted first to number the ones in it */
+        std::vector<std::size_t> kept(vertex_ranges.size());
+        pool.parallel_for(vertex_ranges.size(), [&](std::size_t idx) {
+                const mesh_range &range = vertex_ranges[idx];
+                for (std::size_t vert = range.begin; vert < range.end; ++vert)
+                        kept[idx] += groups[range.mesh].first(vert) == vert;
+        });
+        std::vector<std::size_t> counts(meshes.size());
+        for (std::size_t idx = 0; idx < vertex_ranges.size(); ++idx) {
+                const std::size_t mesh = vertex_ranges[idx].mesh;
+                counts[mesh] += std::exchange(kept[idx], counts[mesh]);
+        }
+        const auto joined = [&meshes, &counts](std::size_t mesh) {
+                return counts[mesh] != meshes[mesh]->mNumVertices;
+        };
+
+        std::vector<std::vector<std::uint32_t>> remap(meshes.size());
+        pool.parallel_for(meshes.size(), [&](std::size_t mesh) {
+                if (joined(mesh))
+                        remap[mesh].resize(meshes[mesh]->mNumVertices);
+        });
+        pool.parallel_for(vertex_ranges.size(), [&](std::size_t idx) {
+                const mesh_range &range = vertex_ranges[idx];
+                if (!joined(range.mesh))
+                        return;
+                std::uint32_t next = kept[idx];
+                for (std::size_t vert = range.begin; vert < range.end;
+                     ++vert) {
+                        remap[range.mesh][vert]
+                            = groups[range.mesh].first(vert) == vert
+                                  ? next++
+                                  : NO_VERTEX;
+                }
+        });
+        const std::vector<mesh_range> face_ranges = split_meshes(
+            meshes.size(), grain, [&meshes, &joined](std::size_t mesh) {
+                    return joined(mesh) ? std::size_t(meshes[mesh]->mNumFaces)
+                                        : 0;
+            });
+        for_ranges(pool, face_ranges, [&](const mesh_range &range) {
+                aiMesh *mesh = meshes[range.mesh];
+                for (std::size_t idx = range.begin; idx < range.end; ++idx) {
+                        aiFace &face = mesh->mFaces[idx];
+                        for (unsigned int corner = 0;
+                             corner < face.mNumIndices; ++corner)
+                                face.mIndices[corner]
+                                    = remap[range.mesh]
+                                           [groups[range.mesh].first(
+                                               face.mIndices[corner])];
+                }
+        });
+        pool.parallel_for(meshes.size(), [&](std::size_t mesh) {
+                if (joined(mesh))
+                        remap_vertices(meshes[mesh], remap[mesh],
+                                       counts[mesh]);
+        });
+}
@@ -0,0 +1,32 @@
+#ifndef POSTPROCESS_HH
+#define POSTPROCESS_HH
+
+#include "scheduler.hh"
+#include <assimp/mesh.h>
+#include <cstddef>
+#include <span>
+
+/*
+  replacements for assimp's GenSmoothNormals and JoinIdenticalVertices
+  steps that run on the pool. every step is split into ranges of at most
+  grain vertices or faces across all meshes, so a single large mesh keeps
+  every worker busy. the results do not depend on the order in which the
+  workers ran.
+
+  both may not be called from a task.
+*/
+
+/* gives the meshes without normals smooth ones. the normal of a vertex is
+ * the sum of the normals of every face around its position weighted by
+ * their area, so vertices at the same place share a normal even when
+ * their uvs differ. meshes without faces are left alone */
+void generate_normals(scheduler &pool, std::span<aiMesh *const> meshes,
+                      std::size_t grain);
+
+/* merges the vertices of every mesh with the same position, uv and
+ * normal into the first of them and renumbers the faces. attributes juc
+ * does not write, such as colors and tangents, are not compared */
+void join_vertices(scheduler &pool, std::span<aiMesh *const> meshes,
+                   std::size_t grain);
+
+#endif
@@ -0,0 +1,94 @@
+#include "reorder.hh"
+#include "mesh_edit.hh"
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace {
+/* spreads the low 21 bits of value out to every third bit */
+std::uint64_t spread_bits(std::uint64_t value) {
+        value &= 0x1fffff;
+        value = (value | value << 32) & 0x1f00000000ffff;
+        value = (value | value << 16) & 0x1f0000ff0000ff;
+        value = (value | value << 8) & 0x100f00f00f00f00f;
+        value = (value | value << 4) & 0x10c30c30c30c30c3;
+        value = (value | value << 2) & 0x1249249249249249;
+        return value;
+}
+
+std::uint64_t morton_code(const aiVector3D &point, const aiVector3D &min,
+                          const aiVector3D &scale) {
+        const auto quantize = [](float value) {
+                return std::uint64_t(std::clamp(value, 0.0f, 1.0f) * 0x1fffff);
+        };
+        return spread_bits(quantize((point.x - min.x) * scale.x))
+               | spread_bits(quantize((point.y - min.y) * scale.y)) << 1
+               | spread_bits(quantize((point.z - min.z) * scale.z)) << 2;
+}
+
+aiVector3D centroid(const aiMesh *mesh, const aiFace &face) {
+        aiVector3D sum(0, 0, 0);
+        for (unsigned int idx = 0; idx < face.mNumIndices; ++idx)
+                sum += mesh->mVertices[face.mIndices[idx]];
+        return face.mNumIndices == 0 ? sum : sum / float(face.mNumIndices);
+}
+}
+
+void reorder_mesh(aiMesh *mesh) {
+        if (mesh->mNumFaces == 0 || mesh->mVertices == nullptr)
+                return;
+
+        std::vector<aiVector3D> centroids(mesh->mNumFaces);
+        aiVector3D min = centroid(mesh, mesh->mFaces[0]);
+        aiVector3D max = min;
+        for (unsigned int idx = 0; idx < mesh->mNumFaces; ++idx) {
+                const aiVector3D point = centroid(mesh, mesh->mFaces[idx]);
+                centroids[idx] = point;
+                min = aiVector3D(std::min(min.x, point.x),
+                                 std::min(min.y, point.y),
+                                 std::min(min.z, point.z));
+                max = aiVector3D(std::max(max.x, point.x),
+                                 std::max(max.y, point.y),
+                                 std::max(max.z, point.z));
+        }
+        const auto inverse = [](float extent) {
+                return extent > 0.0f ? 1.0f / extent : 0.0f;
+        };
+        const aiVector3D scale(inverse(max.x - min.x), inverse(max.y - min.y),
+                               inverse(max.z - min.z));
+
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> keys(
+            mesh->mNumFaces);
+        for (std::uint32_t idx = 0; idx < mesh->mNumFaces; ++idx)
+                keys[idx] = { morton_code(centroids[idx], min, scale), idx };
+        /* the index breaks ties, so the result does not depend on the
+         * sort */
+        std::sort(keys.begin(), keys.end());
+
+        aiFace *const faces = new aiFace[mesh->mNumFaces];
+        for (std::size_t idx = 0; idx < keys.size(); ++idx) {
+                aiFace &src = mesh->mFaces[keys[idx].second];
+                std::swap(faces[idx].mIndices, src.mIndices);
+                faces[idx].mNumIndices = src.mNumIndices;
+        }
+        delete[] mesh->mFaces;
+        mesh->mFaces = faces;
+
+        std::vector<std::uint32_t> remap(mesh->mNumVertices, NO_VERTEX);
+        std::uint32_t count = 0;
+        for (unsigned int face = 0; face < mesh->mNumFaces; ++face) {
+                aiFace &dst = mesh->mFaces[face];
+                for (unsigned int idx = 0; idx < dst.mNumIndices; ++idx) {
+                        std::uint32_t &target = remap[dst.mIndices[idx]];
+                        if (target == NO_VERTEX)
+                                target = count++;
+                        dst.mIndices[idx] = target;
+                }
+        }
+        for (std::uint32_t &target : remap) {
+                if (target == NO_VERTEX)
+                        target = count++;
+        }
+        remap_vertices(mesh, remap, count);
+}
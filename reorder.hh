@@ -0,0 +1,14 @@
+#ifndef REORDER_HH
+#define REORDER_HH
+
+#include <assimp/mesh.h>
+
+/*
+  sorts the faces of mesh along a morton curve through their centroids and
+  then numbers the vertices in the order the faces first use them, so
+  faces and vertices that are close in the output are close in space as
+  well. vertices no face uses go last, in their original order.
+*/
+void reorder_mesh(aiMesh *mesh);
+
+#endif
@@ -0,0 +1,169 @@
+#include "scheduler.hh"
+#include <algorithm>
+#include <exception>
+#include <latch>
+
+namespace {
+/* the scheduler and index of the worker running on this thread, if any */
+thread_local const scheduler *current_scheduler = nullptr;
+thread_local std::size_t current_worker = 0;
+
+std::size_t worker_count(std::size_t threads) {
+        if (threads != 0)
+                return threads;
+        return std::max(1u, std::thread::hardware_concurrency());
+}
+}
+
+scheduler::scheduler(std::size_t threads, stats *s)
+    : _workers(worker_count(threads)),
+      _io_workers(_workers == 1 ? 0 : std::max<std::size_t>(1, _workers / 4)),
+      _io_limit(std::max<std::size_t>(1, _io_workers)), _stats(s) {
+        _local = std::make_unique<queue[]>(_workers);
+        for (std::size_t idx = 0; idx < _workers; ++idx)
+                _threads.emplace_back([this, idx]() { work(idx); });
+}
+
+scheduler::~scheduler() {
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+        }
+        _wake.notify_all();
+        for (std::thread &thread : _threads)
+                thread.join();
+}
+
+void scheduler::submit(task_class cls, task &&fn) {
+        queue &target = current_scheduler == this ? _local[current_worker]
+                                                  : _global;
+        entry ent{ std::move(fn), {} };
+        if (_stats != nullptr)
+                ent.queued = stats::clock::now();
+        {
+                std::lock_guard<std::mutex> lock(target.mutex);
+                target.tasks[static_cast<std::size_t>(cls)].push_back(
+                    std::move(ent));
+        }
+        _queued[static_cast<std::size_t>(cls)] += 1;
+        {
+                /* taken so a worker cannot miss the wake up between
+                 * checking _queued and going to sleep */
+                std::lock_guard<std::mutex> lock(_mutex);
+        }
+        _wake.notify_one();
+}
+
+void scheduler::parallel_for(std::size_t count,
+                             const std::function<void(std::size_t)> &fn) {
+        std::latch done(count);
+        std::mutex mutex;
+        std::exception_ptr error;
+
+        for (std::size_t idx = 0; idx < count; ++idx) {
+                submit(task_class::cpu, [&, idx]() {
+                        try {
+                                fn(idx);
+                        } catch (...) {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                if (!error)
+                                        error = std::current_exception();
+                        }
+                        done.count_down();
+                });
+        }
+        done.wait();
+        if (error)
+                std::rethrow_exception(error);
+}
+
+void scheduler::work(std::size_t self) {
+        const std::size_t preferred
+            = static_cast<std::size_t>(self < _io_workers ? task_class::io
+                                                          : task_class::cpu);
+        current_scheduler = this;
+        current_worker = self;
+        while (true) {
+                entry ent;
+                std::size_t cls = preferred;
+                if (take(self, cls, ent)
+                    || take(self, cls = CLASS_COUNT - 1 - preferred, ent)) {
+                        if (_stats != nullptr) {
+                                const stats::clock::time_point start
+                                    = stats::clock::now();
+                                ent.fn();
+                                _stats->add_task(cls, start - ent.queued,
+                                                 stats::clock::now() - start);
+                        } else {
+                                ent.fn();
+                        }
+                        ent.fn = nullptr;
+                        if (cls == static_cast<std::size_t>(task_class::io)) {
+                                /* workers may be waiting for the slot, or
+                                 * for the last task to stop */
+                                _io_running -= 1;
+                                std::lock_guard<std::mutex> lock(_mutex);
+                                _wake.notify_all();
+                        }
+                        continue;
+                }
+                std::unique_lock<std::mutex> lock(_mutex);
+                const auto done = [this]() {
+                        return _stop && _queued[0] == 0 && _queued[1] == 0;
+                };
+                if (done())
+                        return;
+                _wake.wait(lock, [this, &done]() {
+                        return done() || runnable();
+                });
+        }
+}
+
+bool scheduler::runnable() const {
+        return _queued[static_cast<std::size_t>(task_class::cpu)] != 0
+               || (_queued[static_cast<std::size_t>(task_class::io)] != 0
+                   && _io_running < _io_limit);
+}
+
+bool scheduler::take(std::size_t self, std::size_t cls, entry &ent) {
+        const bool io = cls == static_cast<std::size_t>(task_class::io);
+        if (io && _io_running.fetch_add(1) >= _io_limit) {
+                _io_running -= 1;
+                return false;
+        }
+        if (!pop(self, cls, ent)) {
+                if (io)
+                        _io_running -= 1;
+                return false;
+        }
+        _queued[cls] -= 1;
+        return true;
+}
+
+bool scheduler::pop(std::size_t self, std::size_t cls, entry &ent) {
+        if (pop_back(_local[self], cls, ent) || pop_front(_global, cls, ent))
+                return true;
+        for (std::size_t idx = 1; idx < _workers; ++idx) {
+                if (pop_front(_local[(self + idx) % _workers], cls, ent))
+                        return true;
+        }
+        return false;
+}
+
+bool scheduler::pop_front(queue &queue, std::size_t cls, entry &ent) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks[cls].empty())
+                return false;
+        ent = std::move(queue.tasks[cls].front());
+        queue.tasks[cls].pop_front();
+        return true;
+}
+
+bool scheduler::pop_back(queue &queue, std::size_t cls, entry &ent) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks[cls].empty())
+                return false;
+        ent = std::move(queue.tasks[cls].back());
+        queue.tasks[cls].pop_back();
+        return true;
+}
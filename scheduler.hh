@@ -0,0 +1,97 @@
+#ifndef SCHEDULER_HH
+#define SCHEDULER_HH
+
+#include "stats.hh"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  cpu tasks format meshes and other geometry, io tasks read and write
+  textures through ImageMagick and spend much of their time waiting.
+*/
+enum class task_class { cpu, io };
+
+/*
+  work stealing thread pool. tasks submitted from outside the pool go to a
+  shared queue per class that is served first in, first out, tasks
+  submitted by a worker go to that worker's own queue and may be stolen by
+  idle workers.
+
+  a quarter of the workers (at least one when there is more than one
+  worker) prefer io tasks and the others prefer cpu tasks. every worker
+  falls back to the other class when its own has nothing left, but no
+  more io tasks run at once than there are io workers. a queue full of
+  textures therefore leaves the other workers free for the cpu tasks that
+  arrive after it.
+
+  tasks must not throw.
+*/
+class scheduler {
+      public:
+        using task = std::function<void()>;
+
+      private:
+        static constexpr std::size_t CLASS_COUNT = 2;
+
+        struct entry {
+                task fn;
+                /* only set when collecting stats */
+                stats::clock::time_point queued;
+        };
+
+        struct queue {
+                std::mutex mutex;
+                std::deque<entry> tasks[CLASS_COUNT];
+        };
+
+        std::unique_ptr<queue[]> _local;
+        queue _global;
+        std::vector<std::thread> _threads;
+        std::size_t _workers;
+        std::size_t _io_workers;
+        /* io tasks that may run at once */
+        std::size_t _io_limit;
+        stats *const _stats;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::atomic<std::size_t> _queued[CLASS_COUNT] = {};
+        std::atomic<std::size_t> _io_running = 0;
+        bool _stop = false;
+
+      public:
+        scheduler() = delete;
+        /* zero threads means one per hardware thread. when s is not null
+         * the queue wait and run time of every task is recorded in it */
+        explicit scheduler(std::size_t threads, stats *s = nullptr);
+        scheduler(const scheduler &other) = delete;
+        ~scheduler();
+
+        scheduler &operator=(const scheduler &other) = delete;
+
+        void submit(task_class cls, task &&fn);
+        /* runs fn(idx) for every idx below count as cpu tasks and waits for
+         * them, rethrowing the first exception any of them threw. may not
+         * be called from a task */
+        void parallel_for(std::size_t count,
+                          const std::function<void(std::size_t)> &fn);
+
+        inline std::size_t size() const { return _workers; }
+
+      private:
+        void work(std::size_t self);
+        /* whether a worker could take a task now */
+        bool runnable() const;
+        bool take(std::size_t self, std::size_t cls, entry &ent);
+        bool pop(std::size_t self, std::size_t cls, entry &ent);
+        static bool pop_front(queue &queue, std::size_t cls, entry &ent);
+        static bool pop_back(queue &queue, std::size_t cls, entry &ent);
+};
+
+#endif
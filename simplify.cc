@@ -0,0 +1,363 @@
+#include "simplify.hh"
+#include "mesh_edit.hh"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace {
+using index_t = std::uint32_t;
+
+struct vec3 {
+        double x, y, z;
+
+        vec3(double x, double y, double z) : x(x), y(y), z(z) {}
+        vec3(const aiVector3D &vec) : x(vec.x), y(vec.y), z(vec.z) {}
+
+        vec3 operator-(const vec3 &other) const {
+                return vec3(x - other.x, y - other.y, z - other.z);
+        }
+        double dot(const vec3 &other) const {
+                return x * other.x + y * other.y + z * other.z;
+        }
+        vec3 cross(const vec3 &other) const {
+                return vec3(y * other.z - z * other.y,
+                            z * other.x - x * other.z,
+                            x * other.y - y * other.x);
+        }
+};
+
+/* symmetric 4x4 matrix of a quadric error, stored as its upper triangle */
+struct quadric {
+        std::array<double, 10> q = {};
+
+        quadric &operator+=(const quadric &other) {
+                for (std::size_t idx = 0; idx < q.size(); ++idx)
+                        q[idx] += other.q[idx];
+                return *this;
+        }
+        quadric operator+(const quadric &other) const {
+                quadric result = *this;
+                return result += other;
+        }
+        double error(const vec3 &p) const {
+                return q[0] * p.x * p.x + 2 * q[1] * p.x * p.y
+                       + 2 * q[2] * p.x * p.z + 2 * q[3] * p.x
+                       + q[4] * p.y * p.y + 2 * q[5] * p.y * p.z
+                       + 2 * q[6] * p.y + q[7] * p.z * p.z + 2 * q[8] * p.z
+                       + q[9];
+        }
+
+        /* squared distance to the plane through a, b and c, weighted by
+         * the area of the triangle */
+        static quadric plane(const vec3 &a, const vec3 &b, const vec3 &c) {
+                const vec3 normal = (b - a).cross(c - a);
+                const double len = std::sqrt(normal.dot(normal));
+                quadric result;
+                if (len == 0.0)
+                        return result;
+                const double nx = normal.x / len, ny = normal.y / len,
+                             nz = normal.z / len;
+                const double d = -(nx * a.x + ny * a.y + nz * a.z);
+                const double w = len / 2;
+                result.q = { w * nx * nx, w * nx * ny, w * nx * nz,
+                             w * nx * d,  w * ny * ny, w * ny * nz,
+                             w * ny * d,  w * nz * nz, w * nz * d,
+                             w * d * d };
+                return result;
+        }
+};
+
+/* twice the area over the sum of the squared edge lengths, about 0.58 for
+ * an equilateral triangle and 0 for a degenerate one */
+double quality(const vec3 &a, const vec3 &b, const vec3 &c) {
+        const vec3 normal = (b - a).cross(c - a);
+        const double edges
+            = (b - a).dot(b - a) + (c - b).dot(c - b) + (a - c).dot(a - c);
+        return edges == 0.0 ? 0.0 : std::sqrt(normal.dot(normal)) / edges;
+}
+
+const static double MIN_QUALITY = 0.05;
+
+/* moving from onto to, valid as long as neither changed since */
+struct collapse {
+        double cost;
+        index_t from, to;
+        std::uint32_t from_version, to_version;
+
+        bool operator>(const collapse &other) const {
+                return cost > other.cost;
+        }
+};
+
+class simplifier {
+        aiMesh *const _mesh;
+        std::vector<std::array<index_t, 3>> _triangles;
+        /* index into mFaces of every triangle */
+        std::vector<index_t> _faces;
+        std::vector<bool> _alive;
+        std::size_t _alive_count = 0;
+        std::vector<std::vector<index_t>> _vertex_triangles;
+        std::vector<quadric> _quadrics;
+        std::vector<std::uint32_t> _versions;
+        std::vector<bool> _locked;
+        std::vector<bool> _removed;
+        std::priority_queue<collapse, std::vector<collapse>,
+                            std::greater<collapse>>
+            _queue;
+
+      public:
+        explicit simplifier(aiMesh *mesh);
+
+        std::size_t run(std::size_t target);
+
+      private:
+        inline vec3 position(index_t vert) const {
+                return vec3(_mesh->mVertices[vert]);
+        }
+        void lock_borders();
+        void push(index_t a, index_t b);
+        void neighbours(index_t vert, std::vector<index_t> &result) const;
+        bool can_collapse(index_t from, index_t to) const;
+        void apply(index_t from, index_t to);
+        void compact();
+};
+
+simplifier::simplifier(aiMesh *mesh)
+    : _mesh(mesh), _vertex_triangles(mesh->mNumVertices),
+      _quadrics(mesh->mNumVertices), _versions(mesh->mNumVertices),
+      _locked(mesh->mNumVertices), _removed(mesh->mNumVertices) {
+        for (index_t face = 0; face < mesh->mNumFaces; ++face) {
+                const aiFace &src = mesh->mFaces[face];
+                if (src.mNumIndices != 3) {
+                        std::for_each_n(src.mIndices, src.mNumIndices,
+                                        [this](index_t vert) {
+                                                _locked[vert] = true;
+                                        });
+                        continue;
+                }
+                const index_t tri = _triangles.size();
+                _triangles.push_back(
+                    { src.mIndices[0], src.mIndices[1], src.mIndices[2] });
+                _faces.push_back(face);
+                const quadric plane = quadric::plane(
+                    position(src.mIndices[0]), position(src.mIndices[1]),
+                    position(src.mIndices[2]));
+                for (const index_t vert : _triangles.back()) {
+                        _vertex_triangles[vert].push_back(tri);
+                        _quadrics[vert] += plane;
+                }
+        }
+        _alive.assign(_triangles.size(), true);
+        _alive_count = mesh->mNumFaces;
+        lock_borders();
+        for (const std::array<index_t, 3> &tri : _triangles) {
+                push(tri[0], tri[1]);
+                push(tri[1], tri[2]);
+                push(tri[2], tri[0]);
+        }
+}
+
+std::size_t simplifier::run(std::size_t target) {
+        const std::size_t before = _alive_count;
+
+        while (_alive_count > target && !_queue.empty()) {
+                const collapse top = _queue.top();
+                _queue.pop();
+                if (_removed[top.from] || _removed[top.to]
+                    || _versions[top.from] != top.from_version
+                    || _versions[top.to] != top.to_version)
+                        continue;
+                if (can_collapse(top.from, top.to))
+                        apply(top.from, top.to);
+        }
+        if (_alive_count != before)
+                compact();
+        return _alive_count;
+}
+
+void simplifier::lock_borders() {
+        std::vector<std::uint64_t> edges;
+        edges.reserve(_triangles.size() * 3);
+        for (const std::array<index_t, 3> &tri : _triangles) {
+                for (std::size_t idx = 0; idx < 3; ++idx) {
+                        const index_t a = tri[idx], b = tri[(idx + 1) % 3];
+                        edges.push_back(std::uint64_t(std::min(a, b)) << 32
+                                        | std::max(a, b));
+                }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (std::size_t idx = 0; idx < edges.size();) {
+                std::size_t end = idx;
+                while (end < edges.size() && edges[end] == edges[idx])
+                        ++end;
+                if (end - idx != 2) {
+                        _locked[edges[idx] >> 32] = true;
+                        _locked[edges[idx] & 0xffffffff] = true;
+                }
+                idx = end;
+        }
+}
+
+void simplifier::push(index_t a, index_t b) {
+        const quadric sum = _quadrics[a] + _quadrics[b];
+        if (!_locked[a])
+                _queue.push({ sum.error(position(b)), a, b, _versions[a],
+                              _versions[b] });
+        if (!_locked[b])
+                _queue.push({ sum.error(position(a)), b, a, _versions[b],
+                              _versions[a] });
+}
+
+void simplifier::neighbours(index_t vert,
+                            std::vector<index_t> &result) const {
+        result.clear();
+        for (const index_t tri : _vertex_triangles[vert]) {
+                for (const index_t other : _triangles[tri]) {
+                        if (other != vert)
+                                result.push_back(other);
+                }
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+}
+
+bool simplifier::can_collapse(index_t from, index_t to) const {
+        std::vector<index_t> from_ring, to_ring, common;
+        std::size_t shared = 0;
+
+        /* the vertices around both ends may only meet at the triangles
+         * that are removed, or the surface would fold onto itself */
+        for (const index_t tri : _vertex_triangles[from]) {
+                const std::array<index_t, 3> &verts = _triangles[tri];
+                shared += std::find(verts.begin(), verts.end(), to)
+                          != verts.end();
+        }
+        neighbours(from, from_ring);
+        neighbours(to, to_ring);
+        std::set_intersection(from_ring.begin(), from_ring.end(),
+                              to_ring.begin(), to_ring.end(),
+                              std::back_inserter(common));
+        if (shared == 0 || common.size() != shared)
+                return false;
+
+        const vec3 target = position(to);
+        for (const index_t tri : _vertex_triangles[from]) {
+                const std::array<index_t, 3> &verts = _triangles[tri];
+                if (std::find(verts.begin(), verts.end(), to) != verts.end())
+                        continue;
+                const vec3 a = position(verts[0]), b = position(verts[1]),
+                           c = position(verts[2]);
+                const vec3 moved_a = verts[0] == from ? target : a;
+                const vec3 moved_b = verts[1] == from ? target : b;
+                const vec3 moved_c = verts[2] == from ? target : c;
+                const vec3 before = (b - a).cross(c - a);
+                const vec3 after
+                    = (moved_b - moved_a).cross(moved_c - moved_a);
+                /* rejects flipped triangles, and ones that turn so far
+                 * they stand on their edge */
+                if (before.dot(after)
+                    <= 0.25 * std::sqrt(before.dot(before) * after.dot(after)))
+                        return false;
+                /* and ones that become slivers */
+                if (quality(moved_a, moved_b, moved_c) < MIN_QUALITY)
+                        return false;
+        }
+        return true;
+}
+
+void simplifier::apply(index_t from, index_t to) {
+        std::vector<index_t> &to_triangles = _vertex_triangles[to];
+
+        for (const index_t tri : _vertex_triangles[from]) {
+                std::array<index_t, 3> &verts = _triangles[tri];
+                if (std::find(verts.begin(), verts.end(), to) != verts.end()) {
+                        _alive[tri] = false;
+                        _alive_count -= 1;
+                        for (const index_t vert : verts) {
+                                std::vector<index_t> &list
+                                    = _vertex_triangles[vert];
+                                if (vert != from)
+                                        list.erase(std::find(list.begin(),
+                                                             list.end(), tri));
+                        }
+                        continue;
+                }
+                std::replace(verts.begin(), verts.end(), from, to);
+                to_triangles.push_back(tri);
+        }
+        _vertex_triangles[from].clear();
+        _quadrics[to] += _quadrics[from];
+        _removed[from] = true;
+        _versions[from] += 1;
+        _versions[to] += 1;
+
+        std::vector<index_t> ring;
+        neighbours(to, ring);
+        for (const index_t other : ring)
+                push(to, other);
+}
+
+void simplifier::compact() {
+        std::vector<bool> keep_face(_mesh->mNumFaces, true);
+        for (std::size_t tri = 0; tri < _triangles.size(); ++tri)
+                keep_face[_faces[tri]] = _alive[tri];
+
+        /* surviving vertices keep their relative order */
+        std::vector<index_t> remap(_mesh->mNumVertices, NO_VERTEX);
+        for (std::size_t tri = 0; tri < _triangles.size(); ++tri) {
+                if (!_alive[tri])
+                        continue;
+                for (const index_t vert : _triangles[tri])
+                        remap[vert] = 0;
+        }
+        for (index_t face = 0; face < _mesh->mNumFaces; ++face) {
+                const aiFace &src = _mesh->mFaces[face];
+                if (src.mNumIndices != 3)
+                        std::for_each_n(
+                            src.mIndices, src.mNumIndices,
+                            [&remap](index_t vert) { remap[vert] = 0; });
+        }
+        index_t count = 0;
+        for (index_t &target : remap) {
+                if (target != NO_VERTEX)
+                        target = count++;
+        }
+
+        aiFace *const faces = new aiFace[_alive_count];
+        std::size_t face_count = 0;
+        for (std::size_t tri = 0, face = 0; face < _mesh->mNumFaces; ++face) {
+                aiFace &src = _mesh->mFaces[face];
+                const bool triangle = src.mNumIndices == 3;
+                if (keep_face[face]) {
+                        aiFace &dst = faces[face_count++];
+                        std::swap(dst.mIndices, src.mIndices);
+                        dst.mNumIndices = src.mNumIndices;
+                        if (triangle)
+                                std::copy(_triangles[tri].begin(),
+                                          _triangles[tri].end(),
+                                          dst.mIndices);
+                        std::for_each_n(
+                            dst.mIndices, dst.mNumIndices,
+                            [&remap](unsigned int &vert) {
+                                    vert = remap[vert];
+                            });
+                }
+                tri += triangle;
+        }
+        delete[] _mesh->mFaces;
+        _mesh->mFaces = faces;
+        _mesh->mNumFaces = face_count;
+
+        remap_vertices(_mesh, remap, count);
+}
+}
+
+std::size_t simplify_mesh(aiMesh *mesh, std::size_t target) {
+        if (mesh->mNumFaces <= target || mesh->mVertices == nullptr)
+                return mesh->mNumFaces;
+        return simplifier(mesh).run(target);
+}
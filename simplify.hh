@@ -0,0 +1,22 @@
+#ifndef SIMPLIFY_HH
+#define SIMPLIFY_HH
+
+#include <assimp/mesh.h>
+#include <cstddef>
+
+/*
+  reduces mesh to at most target faces with quadric error edge collapses,
+  or as close as it can get. every collapse moves one vertex onto a
+  neighbour, so the surviving vertices keep their uvs and normals as they
+  are.
+
+  vertices on an edge that is not shared by exactly two triangles never
+  move. after JoinIdenticalVertices uv seams and hard edges are such edges,
+  and a mesh has a single material, so seams and material boundaries stay
+  where they are. faces that are not triangles are left alone.
+
+  returns the number of faces left.
+*/
+std::size_t simplify_mesh(aiMesh *mesh, std::size_t target);
+
+#endif
@@ -0,0 +1,137 @@
+#include "stats.hh"
+#include <ctime>
+#include <iomanip>
+#include <sys/resource.h>
+
+namespace {
+double seconds(std::uint64_t ns) { return ns / 1e9; }
+
+template <typename T> void atomic_max(std::atomic<T> &value, T other) {
+        T prev = value;
+        while (prev < other && !value.compare_exchange_weak(prev, other))
+                ;
+}
+
+void write_string(std::ostream &stream, const std::string &str) {
+        stream << '"';
+        for (const char ch : str) {
+                if (ch == '"' || ch == '\\')
+                        stream << '\\' << ch;
+                else if (static_cast<unsigned char>(ch) < 0x20)
+                        stream << "\\u" << std::hex << std::setw(4)
+                               << std::setfill('0') << int(ch) << std::dec;
+                else
+                        stream << ch;
+        }
+        stream << '"';
+}
+}
+
+stats::phase_timer::phase_timer(stats *s, const std::string &name)
+    : _stats(s) {
+        if (_stats == nullptr)
+                return;
+        _name = name;
+        _wall = clock::now();
+        _cpu = cpu_time();
+}
+
+stats::phase_timer::~phase_timer() {
+        if (_stats == nullptr)
+                return;
+        const std::chrono::duration<double> wall = clock::now() - _wall;
+        _stats->add_phase(_name, wall.count(), cpu_time() - _cpu);
+}
+
+stats::stats(const std::string &input)
+    : _start(clock::now()), _start_cpu(cpu_time()), input(input) {}
+
+void stats::add_phase(const std::string &name, double wall, double cpu) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _phases.push_back({ name, wall, cpu });
+}
+
+void stats::add_task(std::size_t cls, clock::duration wait,
+                     clock::duration run) {
+        task_counters &counters = _tasks[cls];
+        const std::uint64_t wait_ns
+            = std::chrono::nanoseconds(wait).count();
+        const std::uint64_t run_ns = std::chrono::nanoseconds(run).count();
+
+        counters.count += 1;
+        counters.wait_ns += wait_ns;
+        counters.run_ns += run_ns;
+        atomic_max(counters.max_wait_ns, wait_ns);
+        atomic_max(counters.max_run_ns, run_ns);
+}
+
+void stats::add_error(double point, double uv, double normal) {
+        atomic_max(_max_error[0], point);
+        atomic_max(_max_error[1], uv);
+        atomic_max(_max_error[2], normal);
+}
+
+void stats::write_json(std::ostream &stream) const {
+        static const char *const CLASS_NAMES[] = { "cpu", "io" };
+        const std::chrono::duration<double> wall = clock::now() - _start;
+        double geometry_time = 0.0;
+        for (const phase &ph : _phases) {
+                if (ph.name == "meshes")
+                        geometry_time += ph.wall;
+        }
+
+        stream << "{\n  \"input\": ";
+        write_string(stream, input);
+        stream << ",\n  \"threads\": " << threads
+               << ",\n  \"wall_seconds\": " << wall.count()
+               << ",\n  \"cpu_seconds\": " << cpu_time() - _start_cpu
+               << ",\n  \"phases\": [";
+        for (std::size_t idx = 0; idx < _phases.size(); ++idx) {
+                stream << (idx == 0 ? "\n" : ",\n") << "    {\"name\": ";
+                write_string(stream, _phases[idx].name);
+                stream << ", \"wall_seconds\": " << _phases[idx].wall
+                       << ", \"cpu_seconds\": " << _phases[idx].cpu << "}";
+        }
+        stream << "\n  ],\n  \"tasks\": {";
+        for (std::size_t cls = 0; cls < 2; ++cls) {
+                const task_counters &counters = _tasks[cls];
+                stream << (cls == 0 ? "\n" : ",\n") << "    \""
+                       << CLASS_NAMES[cls] << "\": {\"count\": "
+                       << counters.count << ", \"queue_wait_seconds\": "
+                       << seconds(counters.wait_ns)
+                       << ", \"max_queue_wait_seconds\": "
+                       << seconds(counters.max_wait_ns)
+                       << ", \"run_seconds\": " << seconds(counters.run_ns)
+                       << ", \"max_run_seconds\": "
+                       << seconds(counters.max_run_ns) << "}";
+        }
+        stream << "\n  },\n  \"bytes_emitted\": " << _bytes
+               << ",\n  \"bytes_written\": " << _bytes_written
+               << ",\n  \"vertices\": " << _vertices
+               << ",\n  \"faces\": " << _faces
+               << ",\n  \"vertices_per_second\": "
+               << (geometry_time > 0.0 ? _vertices / geometry_time : 0.0)
+               << ",\n  \"faces_per_second\": "
+               << (geometry_time > 0.0 ? _faces / geometry_time : 0.0)
+               << ",\n  \"textures_converted\": " << _textures
+               << ",\n  \"texture_cache_hits\": " << _texture_hits
+               << ",\n  \"chunks\": " << _chunks
+               << ",\n  \"chunks_reused\": " << _chunks_reused
+               << ",\n  \"max_position_error\": " << _max_error[0]
+               << ",\n  \"max_uv_error\": " << _max_error[1]
+               << ",\n  \"max_normal_error\": " << _max_error[2]
+               << ",\n  \"peak_rss_bytes\": " << peak_rss() << "\n}\n";
+}
+
+double stats::cpu_time() {
+        struct timespec time;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+        return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+std::uint64_t stats::peak_rss() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        /* linux reports kilobytes */
+        return std::uint64_t(usage.ru_maxrss) * 1024;
+}
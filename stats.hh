@@ -0,0 +1,112 @@
+#ifndef STATS_HH
+#define STATS_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+  counters and timings of a single conversion, written as json by --stats.
+  everything that can be recorded from worker threads is atomic, so
+  recording a task costs two clock reads and a handful of atomic adds.
+  vertices and faces per second are measured against the meshes phase.
+*/
+class stats {
+      public:
+        using clock = std::chrono::steady_clock;
+
+        /* records the wall and cpu time from construction to destruction
+         * as a phase, does nothing when s is null */
+        class phase_timer {
+                stats *_stats;
+                std::string _name;
+                clock::time_point _wall;
+                double _cpu;
+
+              public:
+                phase_timer(stats *s, const std::string &name);
+                phase_timer(const phase_timer &other) = delete;
+                ~phase_timer();
+
+                phase_timer &operator=(const phase_timer &other) = delete;
+        };
+
+      private:
+        struct phase {
+                std::string name;
+                double wall;
+                double cpu;
+        };
+
+        struct task_counters {
+                std::atomic<std::uint64_t> count = 0;
+                std::atomic<std::uint64_t> wait_ns = 0;
+                std::atomic<std::uint64_t> max_wait_ns = 0;
+                std::atomic<std::uint64_t> run_ns = 0;
+                std::atomic<std::uint64_t> max_run_ns = 0;
+        };
+
+        const clock::time_point _start;
+        const double _start_cpu;
+        std::mutex _mutex;
+        std::vector<phase> _phases;
+        task_counters _tasks[2];
+        std::atomic<std::uint64_t> _bytes = 0;
+        std::atomic<std::uint64_t> _bytes_written = 0;
+        std::atomic<std::uint64_t> _vertices = 0;
+        std::atomic<std::uint64_t> _faces = 0;
+        std::atomic<std::uint64_t> _textures = 0;
+        std::atomic<std::uint64_t> _texture_hits = 0;
+        std::atomic<std::uint64_t> _chunks = 0;
+        std::atomic<std::uint64_t> _chunks_reused = 0;
+        /* largest difference between a written vertex attribute and the
+         * one it was written from */
+        std::atomic<double> _max_error[3] = { 0.0, 0.0, 0.0 };
+
+      public:
+        const std::string input;
+        std::size_t threads = 0;
+
+        stats() = delete;
+        explicit stats(const std::string &input);
+        stats(const stats &other) = delete;
+        ~stats() = default;
+
+        stats &operator=(const stats &other) = delete;
+
+        void add_phase(const std::string &name, double wall, double cpu);
+        /* cls is the index of a task_class */
+        void add_task(std::size_t cls, clock::duration wait,
+                      clock::duration run);
+        /* written differs from formatted when the output is compressed */
+        inline void add_bytes(std::uint64_t formatted, std::uint64_t written) {
+                _bytes += formatted;
+                _bytes_written += written;
+        }
+        inline void add_geometry(std::uint64_t vertices, std::uint64_t faces) {
+                _vertices += vertices;
+                _faces += faces;
+        }
+        inline void add_texture(bool cached) {
+                _textures += 1;
+                _texture_hits += cached;
+        }
+        inline void add_chunk(bool reused) {
+                _chunks += 1;
+                _chunks_reused += reused;
+        }
+        void add_error(double point, double uv, double normal);
+
+        void write_json(std::ostream &stream) const;
+
+        /* cpu time used by all threads of the process, in seconds */
+        static double cpu_time();
+        /* largest resident set size of the process so far, in bytes */
+        static std::uint64_t peak_rss();
+};
+
+#endif
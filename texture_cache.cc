@@ -0,0 +1,128 @@
+#include "texture_cache.hh"
+#include "content_hash.hh"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+texture_cache::texture_cache(const std::filesystem::path &directory,
+                             std::uintmax_t max_size)
+    : directory(directory), max_size(max_size) {
+        std::filesystem::create_directories(directory / "staging");
+}
+
+std::string texture_cache::entry_name(const std::filesystem::path &path,
+                                      std::string_view params,
+                                      const std::string &ext) {
+        content_hasher hasher;
+        hasher.update_file(path);
+        hasher.update(params);
+        return hasher.digest() + ext;
+}
+
+std::string texture_cache::entry_name(const void *data, std::size_t size,
+                                      std::string_view params,
+                                      const std::string &ext) {
+        content_hasher hasher;
+        hasher.update(data, size);
+        hasher.update(params);
+        return hasher.digest() + ext;
+}
+
+bool texture_cache::fetch(const std::string &entry,
+                          const std::filesystem::path &to) {
+        const std::filesystem::path from = entry_path(entry);
+        std::error_code err;
+
+        /* the time of last use doubles as the time of last modification */
+        std::filesystem::last_write_time(
+            from, std::filesystem::file_time_type::clock::now(), err);
+        if (err)
+                return false;
+        place(from, to);
+        return true;
+}
+
+std::filesystem::path
+texture_cache::staging_path(const std::string &entry) const {
+        std::ostringstream name;
+        name << getpid() << "-" << std::this_thread::get_id() << "-" << entry;
+        return directory / "staging" / name.str();
+}
+
+void texture_cache::store(const std::string &entry,
+                          const std::filesystem::path &staged,
+                          const std::filesystem::path &to) {
+        const std::filesystem::path path = entry_path(entry);
+
+        place(staged, to);
+        std::filesystem::create_directories(path.parent_path());
+        std::filesystem::rename(staged, path);
+}
+
+std::filesystem::path texture_cache::default_directory() {
+        if (const char *cache = std::getenv("XDG_CACHE_HOME"))
+                return std::filesystem::path(cache) / "juc";
+        if (const char *home = std::getenv("HOME"))
+                return std::filesystem::path(home) / ".cache" / "juc";
+        return std::filesystem::temp_directory_path() / "juc";
+}
+
+std::filesystem::path
+texture_cache::entry_path(const std::string &entry) const {
+        return directory / entry.substr(0, 2) / entry;
+}
+
+void texture_cache::place(const std::filesystem::path &from,
+                          const std::filesystem::path &to) {
+        std::error_code err;
+
+        if (to.has_parent_path())
+                std::filesystem::create_directories(to.parent_path());
+        /* never write through an existing link into the cache */
+        std::filesystem::remove(to);
+        std::filesystem::create_hard_link(from, to, err);
+        if (err)
+                std::filesystem::copy_file(from, to);
+}
+
+void texture_cache::trim() {
+        struct cached {
+                std::filesystem::path path;
+                std::uintmax_t size;
+                std::filesystem::file_time_type used;
+        };
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<cached> entries;
+        std::uintmax_t total = 0;
+        std::error_code size_err, time_err, err;
+
+        for (const auto &dir :
+             std::filesystem::directory_iterator(directory)) {
+                if (!dir.is_directory() || dir.path().filename() == "staging")
+                        continue;
+                for (const auto &file :
+                     std::filesystem::directory_iterator(dir.path())) {
+                        const std::uintmax_t size
+                            = file.file_size(size_err);
+                        const auto used = file.last_write_time(time_err);
+                        if (size_err || time_err)
+                                continue;
+                        entries.push_back({ file.path(), size, used });
+                        total += size;
+                }
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const cached &a, const cached &b) {
+                          return a.used < b.used;
+                  });
+        for (const cached &entry : entries) {
+                if (total <= max_size)
+                        break;
+                if (std::filesystem::remove(entry.path, err))
+                        total -= entry.size;
+        }
+}
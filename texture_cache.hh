@@ -0,0 +1,65 @@
+#ifndef TEXTURE_CACHE_HH
+#define TEXTURE_CACHE_HH
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+/*
+  on disk cache of converted textures, shared between runs. an entry is
+  named after the hash of the source texture and of the parameters it was
+  converted with, so a changed source or conversion never hits a stale
+  entry.
+
+  entries are handed out as hard links (or copies where linking is not
+  possible). trim brings the cache back to its maximum size by removing
+  the least recently used entries, it walks the whole cache and is called
+  once a run has stored its textures rather than after every store.
+*/
+class texture_cache {
+        std::mutex _mutex;
+
+      public:
+        const std::filesystem::path directory;
+        const std::uintmax_t max_size;
+
+        texture_cache() = delete;
+        texture_cache(const std::filesystem::path &directory,
+                      std::uintmax_t max_size);
+        texture_cache(const texture_cache &other) = delete;
+        ~texture_cache() = default;
+
+        texture_cache &operator=(const texture_cache &other) = delete;
+
+        /* name of the entry for the texture at path converted with params
+         * into a file with extension ext */
+        static std::string entry_name(const std::filesystem::path &path,
+                                      std::string_view params,
+                                      const std::string &ext);
+        static std::string entry_name(const void *data, std::size_t size,
+                                      std::string_view params,
+                                      const std::string &ext);
+
+        /* places the entry at to, returns false if it is not cached */
+        bool fetch(const std::string &entry, const std::filesystem::path &to);
+        /* a path to convert the entry into before storing it */
+        std::filesystem::path staging_path(const std::string &entry) const;
+        /* places the staged entry at to before storing it, so trimming the
+         * cache, here or in another process, can not take it away */
+        void store(const std::string &entry,
+                   const std::filesystem::path &staged,
+                   const std::filesystem::path &to);
+        void trim();
+
+        /* the default location, $XDG_CACHE_HOME/juc or ~/.cache/juc */
+        static std::filesystem::path default_directory();
+
+      private:
+        std::filesystem::path entry_path(const std::string &entry) const;
+        static void place(const std::filesystem::path &from,
+                          const std::filesystem::path &to);
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "vertex_table.hh"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+vertex_table::vertex_table(std::size_t expected)
+    : _shard_bits(std::countr_zero(std::bit_floor(std::clamp<std::size_t>(
+          expected / SHARD_VERTICES, 1, MAX_SHARD_COUNT)))),
+      _shards(new shard[std::size_t(1) << _shard_bits]) {
+        const std::size_t shards = std::size_t(1) << _shard_bits;
+        const std::size_t capacity = std::bit_ceil(expected * 2 / shards + 16);
+        for (std::size_t idx = 0; idx < shards; ++idx) {
+                _shards[idx].slots.resize(capacity);
+                _shards[idx].entries.reserve(capacity / 2);
+        }
+}
+
+vertex_table::handle vertex_table::insert(const vertex &key,
+                                          unsigned int attributes,
+                                          std::uint64_t position) {
+        std::size_t hash = std::hash<vertex>()(key);
+        boost::hash_combine(hash, attributes);
+        const std::size_t shard_idx
+            = hash & ((std::size_t(1) << _shard_bits) - 1);
+        shard &shard = _shards[shard_idx];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        const std::size_t mask = shard.slots.size() - 1;
+        std::size_t slot = (hash >> _shard_bits) & mask;
+        while (shard.slots[slot] != 0) {
+                const std::uint32_t entry_idx = shard.slots[slot] - 1;
+                entry &ent = shard.entries[entry_idx];
+                if (ent.hash == hash && ent.attributes == attributes
+                    && ent.key == key) {
+                        ent.owner = std::min(ent.owner, position);
+                        return (handle(shard_idx) << 32) | entry_idx;
+                }
+                slot = (slot + 1) & mask;
+        }
+        const std::uint32_t entry_idx = shard.entries.size();
+        shard.entries.push_back({ key, attributes, hash, position, 0 });
+        shard.slots[slot] = entry_idx + 1;
+        if (shard.entries.size() * 2 > shard.slots.size())
+                grow(shard);
+        return (handle(shard_idx) << 32) | entry_idx;
+}
+
+void vertex_table::grow(shard &shard) const {
+        std::vector<std::uint32_t> slots(shard.slots.size() * 2);
+        const std::size_t mask = slots.size() - 1;
+        for (std::size_t idx = 0; idx < shard.entries.size(); ++idx) {
+                std::size_t slot
+                    = (shard.entries[idx].hash >> _shard_bits) & mask;
+                while (slots[slot] != 0)
+                        slot = (slot + 1) & mask;
+                slots[slot] = idx + 1;
+        }
+        shard.slots.swap(slots);
+}
+
+vertex quantize(const vertex &vert, float epsilon) {
+        const auto snap = [epsilon](float value) {
+                /* adding zero turns -0 into 0 */
+                return std::round(value / epsilon) * epsilon + 0.0f;
+        };
+        vertex result;
+        std::transform(vert.point.begin(), vert.point.end(),
+                       result.point.begin(), snap);
+        std::transform(vert.uv.begin(), vert.uv.end(), result.uv.begin(),
+                       snap);
+        std::transform(vert.normal.begin(), vert.normal.end(),
+                       result.normal.begin(), snap);
+        return result;
+}
+
+math::vector<float, 3> snap_normal(const math::vector<float, 3> &normal,
+                                   int bits) {
+        const float sum = std::abs(normal[0]) + std::abs(normal[1])
+                          + std::abs(normal[2]);
+        if (sum == 0.0f)
+                return normal;
+        const auto sign = [](float value) {
+                return value < 0.0f ? -1.0f : 1.0f;
+        };
+        const float steps = float((1u << bits) - 1);
+        const auto snap = [steps](float value) {
+                return std::round((value * 0.5f + 0.5f) * steps) / steps * 2.0f
+                       - 1.0f;
+        };
+
+        /* project onto the octahedron and fold the lower half over */
+        float u = normal[0] / sum;
+        float v = normal[1] / sum;
+        if (normal[2] < 0.0f) {
+                const float fu = (1.0f - std::abs(v)) * sign(u);
+                v = (1.0f - std::abs(u)) * sign(v);
+                u = fu;
+        }
+        u = snap(u);
+        v = snap(v);
+
+        math::vector<float, 3> result
+            = { u, v, 1.0f - std::abs(u) - std::abs(v) };
+        if (result[2] < 0.0f) {
+                result[0] = (1.0f - std::abs(v)) * sign(u);
+                result[1] = (1.0f - std::abs(u)) * sign(v);
+        }
+        const float len = std::sqrt(result[0] * result[0]
+                                    + result[1] * result[1]
+                                    + result[2] * result[2]);
+        for (float &value : result)
+                value = value / len + 0.0f;
+        return result;
+}
+
+float round_decimals(float value, int precision) {
+        if (precision < 0)
+                return value;
+        const double scale = std::pow(10.0, precision);
+        return float(std::nearbyint(double(value) * scale) / scale);
+}
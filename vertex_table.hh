@@ -0,0 +1,96 @@
+#ifndef VERTEX_TABLE_HH
+#define VERTEX_TABLE_HH
+
+#include "converter.hh"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+  concurrent set of vertices used to weld identical vertices across meshes.
+  the table is split into shards that each have their own lock and their own
+  open addressing array, so workers inserting different vertices rarely
+  contend. small tables have fewer shards, down to a single one, so a
+  table per mesh stays cheap for scenes with many small meshes.
+
+  every vertex is inserted together with its position in the output (mesh
+  and index inside the mesh) and the table remembers the smallest position
+  it has seen. the vertex at that position owns the entry, which keeps the
+  result independent of the order in which the workers ran.
+*/
+class vertex_table {
+      public:
+        using handle = std::uint64_t;
+
+        static constexpr std::size_t MAX_SHARD_COUNT = 64;
+        /* expected vertices for every shard before a table gets more */
+        static constexpr std::size_t SHARD_VERTICES = 1024;
+
+      private:
+        struct entry {
+                vertex key;
+                unsigned int attributes;
+                std::size_t hash;
+                std::uint64_t owner;
+                std::uint64_t index;
+        };
+
+        struct shard {
+                std::mutex mutex;
+                /* entry index + 1, or 0 for an empty slot */
+                std::vector<std::uint32_t> slots;
+                std::vector<entry> entries;
+        };
+
+        /* there are 1 << _shard_bits shards */
+        std::size_t _shard_bits;
+        std::unique_ptr<shard[]> _shards;
+
+      public:
+        vertex_table() = delete;
+        explicit vertex_table(std::size_t expected);
+        vertex_table(const vertex_table &other) = delete;
+        ~vertex_table() = default;
+
+        vertex_table &operator=(const vertex_table &other) = delete;
+
+        /* vertices only match when they are written with the same
+         * attributes, see VERTEX_UV */
+        handle insert(const vertex &key, unsigned int attributes,
+                      std::uint64_t position);
+
+        /* these may only be used once no more inserts can happen */
+        inline std::uint64_t owner(handle hnd) const {
+                return get(hnd).owner;
+        }
+        inline std::uint64_t index(handle hnd) const {
+                return get(hnd).index;
+        }
+        inline void set_index(handle hnd, std::uint64_t index) {
+                _shards[hnd >> 32].entries[hnd & 0xffffffff].index = index;
+        }
+
+        static inline std::uint64_t position(std::size_t mesh,
+                                             std::size_t idx) {
+                return (std::uint64_t(mesh) << 32) | idx;
+        }
+
+      private:
+        inline const entry &get(handle hnd) const {
+                return _shards[hnd >> 32].entries[hnd & 0xffffffff];
+        }
+        void grow(shard &shard) const;
+};
+
+/* snaps every component of vert to the nearest multiple of epsilon */
+vertex quantize(const vertex &vert, float epsilon);
+/* snaps a unit normal to the nearest direction that octahedral encoding
+ * with bits per axis can represent */
+math::vector<float, 3> snap_normal(const math::vector<float, 3> &normal,
+                                   int bits);
+/* the value better_float prints for value with the given precision */
+float round_decimals(float value, int precision);
+
+#endif